@@ -28,86 +28,110 @@ please contact mla_licensing@microchip.com
 #include "app.h"
 #include "usb.h"
 #include "usb_config.h"
-
-static const int OUT_H = 0;
-static const int OUT_L = 1;
-static const int IN_H = 1;
-static const int IN_L = 0;
-
+#include "ps2_port.h"
 
 static uint8_t ps2powsts = 0;
-static int g_WaitCnt100us = 0;
-static int g_WaitCnt100usTarget = 0;
+static uint32_t g_SentCnt = 0;	// PS/2へ送信し終えたキー入力のバイト数（g_Buff のレコードを最後まで送り終えたときに数える）
+// 出力をHにしてからラインがHに落ち着くまで待つ時間。calibrateLineSettle()で実測した値から決める
+static uint8_t g_SettleUs = PS2_T_STOPHOLD_US;
+static uint8_t g_SettleTick = PS2_T_STOPHOLD_US * TMR1_TICKS_PER_100US / 100;
+static uint8_t g_WaitCnt100us = 0;	// 直前の送受信が終わってからの時間
 static int g_Wait100us = 0;
+static uint16_t g_Repeat100us = 0;	// 前回のリピートからの時間（taskTypematic()）
 
-
-// 各ピンの入出力設定は、PIN_MANAGER_Initialize()に記述されています。
-inline uint8_t PS2POW_IN()
+// メインループからTMR1を読む。TMR1_ReadTimer()を直接呼ばないこと。
+// TMR1はRD16で、TMR1Lを読んだときの上位バイトをTMR1Hのバッファに取っておくので、TMR1LとTMR1Hの
+// 間にINT0の割込み（hostReq_Isr()）がTMR1を読むと、上位バイトが化ける。読む間だけINT0を止める。
+// 止めている間の立下りはINT0IFに残り、再開したときに割込みになる。
+uint16_t APP_ReadTick(void)
 {
-	return PORTCbits.RC4;
+	const bool bInt0 = EXT_INT0_InterruptIsEnabled();
+	EXT_INT0_InterruptDisable();
+	const uint16_t tick = TMR1_ReadTimer();
+	if (bInt0)
+		EXT_INT0_InterruptEnable();
+	return tick;
 }
 
-inline uint8_t CLK_IN()
+// TMR1の経過時間を100us単位のカウンタ（g_WaitCnt100us、g_Wait100us）へ反映する
+static void updateTimeCount(void)
 {
-	return PORTCbits.RC1;
-}
-
-inline uint8_t DAT_IN()
-{
-	return PORTCbits.RC0;
+	static uint16_t baseTick = 0;
+	while (TMR1_TICKS_PER_100US <= (uint16_t)(APP_ReadTick() - baseTick)) {
+		baseTick += TMR1_TICKS_PER_100US;
+		if(g_WaitCnt100us < 255)
+			++g_WaitCnt100us;
+		++g_Wait100us;
+		if(g_Repeat100us < 0xffff)
+			++g_Repeat100us;
+	}
+	return;
 }
 
-inline void CLK_OUT(int t)
+// TMR1のカウントで ticks だけ待つ（__delay_us()と違い、実行時に決まる値で待てる）
+static void waitTicks(const uint8_t ticks)
 {
-	LATCbits.LC3 = (uint8_t)t;
+	const uint16_t start = APP_ReadTick();
+	while ((uint16_t)(APP_ReadTick() - start) < ticks)
+		;
 	return;
 }
 
-inline void DAT_OUT(int t)
+// 送信待ち時間の計測をやり直す。
+// 直前の送受信で止まっていた時間を、やり直した後の待ち時間として数えないよう、先に反映しておく。
+static void resetWaitCnt100us(void)
 {
-	LATCbits.LC2 = (uint8_t)t;
+	updateTimeCount();
+	g_WaitCnt100us = 0;
 	return;
 }
 
+
 static bool outputClock(void)
 {
   CLK_OUT(OUT_L);
-  __delay_us(35);
+  PS2_DELAY_US(PS2_T_CLKL_US);
   CLK_OUT(OUT_H);
-  __delay_us(35);
+  PS2_DELAY_US(PS2_T_CLKH_US);
   return true;
 }
 
-// @return false 送信禁止だった
-static bool outputBit(const int dt)
+// PS/2のパリティビット（奇数パリティ）。データの1の数が偶数なら1。
+// const なのでプログラムメモリ（フラッシュ）に置かれる。
+static const uint8_t PS2_PARITY[256] =
 {
-	DAT_OUT(dt);
-	__delay_us(5);
-	CLK_OUT(OUT_L);
-	__delay_us(35);
-	CLK_OUT(OUT_H);
-	__delay_us(35);
-	return true;
-}
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0x00
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0x10
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0x20
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0x30
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0x40
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0x50
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0x60
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0x70
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0x80
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0x90
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0xA0
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0xB0
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0xC0
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0xD0
+	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,	// 0xE0
+	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,	// 0xF0
+};
 
 static bool recvDataFromPS2(uint8_t *pData)
 {
 	if( !outputClock() )
 		return false;
 
-	uint8_t cnt = 0;
 	uint8_t data = 0;
-	for(int t = 0; t < 8; ++t){
+	for(uint8_t t = 0; t < 8; ++t){
 		/* データビットを読む */
-		const uint8_t inDt = DAT_IN();
-		cnt += inDt;
-		data |= inDt << t;
+		data |= (uint8_t)(DAT_IN() << t);
 		if( !outputClock() )
 			return false;
 	}
 	/* パリティビットを読む */
-	cnt += DAT_IN();
-	if( (cnt & 0x01) == 0 )
+	if( DAT_IN() != PS2_PARITY[data] )
 		return false;	// 奇数パリティ・エラー
 
 	if( !outputClock() )
@@ -121,201 +145,1411 @@ static bool recvDataFromPS2(uint8_t *pData)
 	DAT_OUT(OUT_L);
 
 	CLK_OUT(OUT_L);
-  	__delay_us(20);
+  	PS2_DELAY_US(PS2_T_ACK_US);
   	CLK_OUT(OUT_H);
 
-  	__delay_us(20);
+	// CLK=Hがラインに反映されてからDAT=Hに戻す
+	waitTicks(g_SettleTick);
 	DAT_OUT(OUT_H);
 	
 	*pData = data;
 	return true;
 }
 
-static bool sendDataToPS2(uint8_t dt)
+/*********************************************************************
+* PS/2への送信
+*	TMR2の割込みで１ビットずつ出力するので、送信中もメインループ（USBの処理）は止まらない。
+*	１ビットの出力は、DATを出力 → PS2_T_DATSETUP_US → CLK=L → CLK=H
+*	CLK=L、CLK=Hの期間は ps2tx_SetClockPeriod() で設定する（'R'コマンドでPC側から変更できる）。
+*	終了ビットの後、ラインが落ち着くまで（g_SettleUs）待ってから送信完了とする。
+*	bMeasureClk を立てておくと、次のフレームでCLKを離すたびにラインがHになるまでの時間を測る
+*	（calibrateLineSettle()）。ホストにはふつうの送信に見える。
+*/
+#define PS2TX_PR2(us)	((uint8_t)((us) * TMR2_COUNTS_PER_US - 1))
+
+// CLKの周期（us）。PS/2の規格では 60us(16.7kHz)～100us(10kHz)、CLK=L、CLK=Hはそれぞれ30us～50us。
+#define PS2TX_CLKPERIOD_MIN_US		60
+#define PS2TX_CLKPERIOD_MAX_US		100
+#define PS2TX_CLKPERIOD_DEFAULT_US	(PS2_T_DATSETUP_US + PS2_T_CLKL_US + PS2_T_CLKH_US)
+
+#define SETTLE_MAX_US				40		// ラインが落ち着くまで待つ時間の最大（calibrateLineSettle()）
+// CLKの立ち上がりを待つ最大の時間（TMR2のカウント）。TMR2で測るCLK=Hの期間（周期 60us のとき最短の 25us）より短くすること
+#define PS2TX_CLKRISE_TIMEOUT		(SETTLE_MAX_US / 2 * TMR2_COUNTS_PER_US)
+#define PS2TX_CLKRISE_INVALID		0xFF
+
+enum PS2TX_PHASE { TXPH_CLKL, TXPH_CLKH, TXPH_HOLD };
+struct PS2TX
 {
-	// スタートビットを出力する
-	if( !outputBit(OUT_L) )
-		return false;
+	volatile bool busy;			// 送信中
+	volatile bool done;			// 送信を終えた（メインループ側で落とす）
+	volatile bool aborted;		// 送信禁止か送信要求のため送信をやめた（メインループ側で落とす）
+	enum PS2TX_PHASE phase;
+	uint16_t frame;				// 出力する値をLSBから（スタート、データ×8、パリティ、終了ビット）
+	uint8_t bitCnt;				// 残りビット数
+	uint8_t dt;					// 送信中のデータ
+	uint8_t lastDt;				// 最後に終了ビットまで送り終えたデータ（RESENDで再送する。メインループだけが使う）
+	uint8_t seqSent;			// 送信中のレコードのうち、送信し終えたバイト数（メインループだけが使う）
+	bool recEnd;				// 送信中のデータがレコードの最後のバイトか（メインループだけが使う）
+	uint8_t clkPeriodUs;		// CLKの周期
+	uint8_t prClkL;				// DATの出力からCLK=Lの終わりまでのPR2
+	uint8_t prClkH;				// CLK=Hの期間のPR2（DATの出力からCLK=Lまでの時間は含まない）
+	uint8_t prStopHold;			// 終了ビットの後の待ちのPR2
+	bool bMeasureClk;			// 次のフレームでCLKの立ち上がり時間を測る（メインループが立て、割込みが落とす）
+	uint8_t clkRise;			// フレームで測ったCLKの立ち上がり時間の最大（TMR2のカウント）
+	volatile bool clkRiseDone;	// clkRise を測り終えた（メインループ側で落とす）
+};
+static struct PS2TX g_Ps2Tx;
 
-	uint8_t cnt = 0;
-	for(int t = 0; t < 8; ++t){
-		/* データビットを書き込む */
-		uint8_t b = (dt >> t) & 0x01;
-		cnt += b;
-		b = (!b) & 0x01;
-		if( !outputBit(b) )
-			return false;
+// CLKを離してから、ラインがHになるまでの時間をTMR2のカウントで測る
+// ホストがCLK=Lにしていて（送信禁止）上がらなければ、このフレームの測定は無効にする
+static void ps2tx_MeasureClkRise(void)
+{
+	const uint8_t start = TMR2;
+	uint8_t elapsed;
+	do {
+		elapsed = (uint8_t)(TMR2 - start);
+		if (CLK_IN() == IN_H) {
+			if (g_Ps2Tx.clkRise < elapsed)
+				g_Ps2Tx.clkRise = elapsed;
+			return;
+		}
+	} while (elapsed < PS2TX_CLKRISE_TIMEOUT);
+	g_Ps2Tx.clkRise = PS2TX_CLKRISE_INVALID;
+	return;
+}
+
+// ホストが送信禁止か送信要求を出したので送信をやめる。レコードはメインループが最初から送りなおす
+static void ps2tx_Abort(void)
+{
+	TMR2_StopTimer();
+	DAT_OUT(OUT_H);
+	g_Ps2Tx.busy = false;
+	g_Ps2Tx.aborted = true;
+	return;
+}
+
+// TMR2の割込みから呼ばれる
+static void ps2tx_Isr(void)
+{
+	switch(g_Ps2Tx.phase)
+	{
+		case TXPH_CLKL:
+		{
+			CLK_OUT(OUT_H);
+			TMR2_LoadPeriodRegister(g_Ps2Tx.prClkH);
+			if (g_Ps2Tx.bMeasureClk)
+				ps2tx_MeasureClkRise();
+			g_Ps2Tx.phase = TXPH_CLKH;
+			break;
+		}
+		case TXPH_CLKH:
+		{
+			if (g_Ps2Tx.bitCnt == 0) {
+				// 終了ビットのCLK=Hの期間の終わり。ホストはこの前のCLK=Lで終了ビットを読んでいる
+				PS2_PROBE_TX_DONE(g_Ps2Tx.dt);
+				TMR2_LoadPeriodRegister(g_Ps2Tx.prStopHold);
+				g_Ps2Tx.phase = TXPH_HOLD;
+				break;
+			}
+			// スタートビットの前にDAT=Lなら、ホストがDATだけで送信要求を出した（OCM 3.8.2）。
+			// 送信をやめれば、メインループがDAT=Lを見て受信に移る。
+			if (g_Ps2Tx.bitCnt == 11 && DAT_IN() == IN_L) {
+				ps2tx_Abort();
+				break;
+			}
+			// 次のビットを出力する。DATの変更からCLK=Lまでの時間もCLK=Lの期間として数える。
+			DAT_OUT(g_Ps2Tx.frame & 0x01);
+			g_Ps2Tx.frame >>= 1;
+			--g_Ps2Tx.bitCnt;
+			TMR2_LoadPeriodRegister(g_Ps2Tx.prClkL);
+			PS2_DELAY_US(PS2_T_DATSETUP_US);
+			// CLK=Hの期間の終わりならラインはHになっているはず。Lならホストが送信禁止にしている。
+			// CLK=Lにする直前に見る。DATを変えている間にホストがCLK=Lにすると、このビットのクロックは
+			// ホストに見えないので、終了ビットでこれを見逃すとホストが捨てたバイトを送り終えたことになる。
+			if (CLK_IN() == IN_L) {
+				ps2tx_Abort();
+				break;
+			}
+			CLK_OUT(OUT_L);
+			g_Ps2Tx.phase = TXPH_CLKL;
+			break;
+		}
+		case TXPH_HOLD:
+		{
+			TMR2_StopTimer();
+			if (g_Ps2Tx.bMeasureClk && g_Ps2Tx.clkRise != PS2TX_CLKRISE_INVALID) {
+				g_Ps2Tx.bMeasureClk = false;
+				g_Ps2Tx.clkRiseDone = true;
+			}
+			g_Ps2Tx.busy = false;
+			g_Ps2Tx.done = true;
+			break;
+		}
 	}
-	/* パリティビットを書き込む */
-	if( !outputBit(cnt & 0x01) )
-		return false;
-	/* 終了ビットを書き込む */
-	if( !outputBit(OUT_H) )
-		return false;
-	__delay_us(20);
+	return;
+}
 
-  return true;
+// 送信時のCLKの周期を設定する。範囲外の値は範囲内に丸める。
+//	CLK=Hの期間には、次のビットのDATを出力してからCLK=Lにするまでの時間（PS2_T_DATSETUP_US）を含む。
+//	CLK=LとCLK=Hがそれぞれ30us～50usに収まるように振り分ける（既定値の75usでは、L=35us、H=40us）。
+static void ps2tx_SetClockPeriod(uint8_t periodUs)
+{
+	if (periodUs < PS2TX_CLKPERIOD_MIN_US)
+		periodUs = PS2TX_CLKPERIOD_MIN_US;
+	if (PS2TX_CLKPERIOD_MAX_US < periodUs)
+		periodUs = PS2TX_CLKPERIOD_MAX_US;
+	uint8_t lowUs = (periodUs - PS2_T_DATSETUP_US) / 2;
+	if (lowUs < 30)
+		lowUs = 30;
+	if (lowUs < periodUs - 50)
+		lowUs = periodUs - 50;
+	const uint8_t highUs = periodUs - lowUs;
+	g_Ps2Tx.clkPeriodUs = periodUs;
+	g_Ps2Tx.prClkL = PS2TX_PR2(PS2_T_DATSETUP_US + lowUs);
+	g_Ps2Tx.prClkH = PS2TX_PR2(highUs - PS2_T_DATSETUP_US);
+	return;
+}
+
+// 後ろにバイトが続くスキャンコードの前置バイトか
+//	セット1 は E0、E1（ブレークコードはメイクコードのbit7を立てたもので、前置バイトはない）
+//	セット2 は E0、F0、E1
+//	セット3 は F0
+static bool isScanCodePrefix(const uint8_t set, const uint8_t dt)
+{
+	if (set == 1)
+		return dt == 0xE0 || dt == 0xE1;
+	if (set == 3)
+		return dt == 0xF0;
+	return dt == 0xE0 || dt == 0xF0 || dt == 0xE1;
+}
+
+// 送信を開始する。送信の完了は g_Ps2Tx.done、送信禁止での中断は g_Ps2Tx.aborted で知る。
+// dt を、DAT_OUT()へそのまま出力できる11ビット分の値にする（LSBから、スタート、データ×8、パリティ、終了ビット）
+// 出力はトランジスタで反転される（OUT_L=1、OUT_H=0）ので、ラインのレベルを反転した値にする。
+static uint16_t ps2tx_EncodeFrame(const uint8_t dt)
+{
+	uint16_t frame = OUT_L;										// スタートビット
+	frame |= (uint16_t)(uint8_t)~dt << 1;						// データビット
+	frame |= (uint16_t)(PS2_PARITY[dt] ? OUT_H : OUT_L) << 9;	// パリティビット
+	frame |= (uint16_t)OUT_H << 10;								// 終了ビット
+	return frame;
+}
+
+static void sendDataToPS2(const uint8_t dt)
+{
+	g_Ps2Tx.dt = dt;
+	g_Ps2Tx.frame = ps2tx_EncodeFrame(dt);
+	g_Ps2Tx.bitCnt = 11;
+	g_Ps2Tx.done = false;
+	g_Ps2Tx.aborted = false;
+	g_Ps2Tx.clkRise = 0;
+	g_Ps2Tx.busy = true;
+	// 最初の割込みでスタートビットを出力する
+	g_Ps2Tx.phase = TXPH_CLKH;
+	EXT_INT0_InterruptDisable();	// 自分の出力でDAT=Lになるので、送信中はホストの送信要求を検出しない
+	TMR2_WriteTimer(0);
+	TMR2_LoadPeriodRegister(PS2TX_PR2(PS2_T_DATSETUP_US));
+	TMR2_StartTimer();
+	return;
+}
+
+/*********************************************************************
+* ホストからの送信要求（DAT=L）の検出
+*	RC0(DAT)の立下りをINT0の割込みで検出し、その時刻を記録しておく。
+*	メインループがDAT_IN()を読むまでにDATが戻ってしまっても要求を取りこぼさないようにし、
+*	RXST_STANBYRXのタイムアウトも要求があった時刻から数える。
+*	（RC0、RC1には状態変化割込み（IOC）が無いので、INT0を使う）
+*	割込みは検出したら止め、RXST_IDOLに戻ってから再開する。送信中、受信中は割込みを止めておくこと
+*	（受信中の__delay_us()の精度を保つため）。
+*/
+static volatile bool g_HostReq = false;
+static volatile uint16_t g_HostReqTick;
+
+// INT0の割込みから呼ばれる
+static void hostReq_Isr(void)
+{
+	EXT_INT0_InterruptDisable();
+	g_HostReqTick = TMR1_ReadTimer();	// 割込みの中なので APP_ReadTick() は使わない
+	g_HostReq = true;
+	return;
+}
+
+// 送信要求の検出を再開する
+static void hostReq_Arm(void)
+{
+	if (g_HostReq || EXT_INT0_InterruptIsEnabled())
+		return;
+	EXT_INT0_InterruptFlagClear();
+	EXT_INT0_InterruptEnable();
+	return;
+}
+
+// 送信要求を受け付ける。@return 要求があった時刻からの経過時間（100us単位）
+static int hostReq_Accept(void)
+{
+	if (!g_HostReq)
+		return 0;
+	const uint16_t elapsed = APP_ReadTick() - g_HostReqTick;
+	g_HostReq = false;
+	return elapsed / TMR1_TICKS_PER_100US;
+}
+
+/*********************************************************************
+* ラインの立ち上がり時間の測定
+*	PS2VKBDの回路はオープンコレクタで、出力をHにしてからラインがHになるまで時間がかかる。
+*	固定の待ち時間（PS2_T_STOPHOLD_US）の代わりに、接続されたボードで実測した立ち上がり時間の
+*	２倍に余裕を加えた時間を待つ。プルアップが強いボードほど待ち時間が短くなる。
+*	DATは、CLK=HのままDATだけをLにして測る（ホストはCLKの立下りでしかDATを読まないので、フレームには見えない）。
+*	CLKは、ホストがCLKの立下りをビットとして数えるので自分では動かさず、次に送信するフレームで
+*	送信の割込みが測る（ps2tx_MeasureClkRise()）。両方がそろったら待ち時間を決めなおす。
+*	ホストがラインをLにしている、またはホストの電源が入っておらずラインが上がらないときは、
+*	それまでの値のままにする。
+*/
+#define SETTLE_MARGIN_US		2
+#define RISE_TIMEOUT_TICKS		TMR1_TICKS_PER_100US	// 100us
+static bool g_bReqCalib = true;			// 次にRXST_IDOLで送信していないときに測定する
+static uint8_t g_DatRiseUs;				// 測ったDATの立ち上がり時間
+
+// DATをLにしてからHに戻し、ラインがHになるまでの時間を測る
+// @return TMR1のカウント。ラインがHにならなければ RISE_TIMEOUT_TICKS
+static uint8_t measureDatRise(void)
+{
+	DAT_OUT(OUT_L);
+	PS2_DELAY_US(50);
+	const uint16_t start = APP_ReadTick();
+	DAT_OUT(OUT_H);
+	uint16_t elapsed;
+	do {
+		elapsed = APP_ReadTick() - start;
+		if (DAT_IN() == IN_H)
+			return (uint8_t)elapsed;
+	} while (elapsed < RISE_TIMEOUT_TICKS);
+	return RISE_TIMEOUT_TICKS;
+}
+
+// DATの立ち上がり時間を測り、次のフレームでCLKの立ち上がり時間を測るようにする
+static void calibrateLineSettle(void)
+{
+	// ホストが通信中なら後でやりなおす
+	if (CLK_IN() == IN_L || DAT_IN() == IN_L)
+		return;
+	g_bReqCalib = false;
+	EXT_INT0_InterruptDisable();	// DAT=Lをホストの送信要求と間違えないように
+	const uint8_t rise = measureDatRise();
+	if (RISE_TIMEOUT_TICKS <= rise)
+		return;
+	// TMR1のカウントをusに切り上げる
+	g_DatRiseUs = (uint8_t)(((uint16_t)rise * 100 + TMR1_TICKS_PER_100US - 1) / TMR1_TICKS_PER_100US);
+	g_Ps2Tx.bMeasureClk = true;
+	return;
+}
+
+// 送信の割込みが測ったCLKの立ち上がり時間と、DATの立ち上がり時間から待ち時間を決める
+static void applyLineSettle(void)
+{
+	// TMR2のカウントをusに切り上げる
+	const uint8_t clkRiseUs = (uint8_t)((g_Ps2Tx.clkRise + TMR2_COUNTS_PER_US - 1) / TMR2_COUNTS_PER_US);
+	const uint8_t rise = (clkRiseUs < g_DatRiseUs) ? g_DatRiseUs : clkRiseUs;
+	uint8_t settleUs = rise * 2 + SETTLE_MARGIN_US;
+	if (SETTLE_MAX_US < settleUs)
+		settleUs = SETTLE_MAX_US;
+	g_SettleUs = settleUs;
+	g_SettleTick = (uint8_t)((uint16_t)settleUs * TMR1_TICKS_PER_100US / 100 + 1);
+	g_Ps2Tx.prStopHold = PS2TX_PR2(settleUs);
+	return;
 }
 
 /*********************************************************************
 */
+// 各バイトを送信する前に空ける最小の間隔（100us単位）。直前の送受信が終わったときから数える。
+#define PS2GAP_CODE		5	// スキャンコードの１バイト目（独立したスキャンコードどうしの間）
+#define PS2GAP_PREFIX	10	// E0、E1 の次のバイト
+#define PS2GAP_BREAK	20	// F0 の次のバイト（ブレークコードの２バイト目。DE0＋DEOCMで必要）
+#define PS2GAP_RESPONSE	4	// ホストのコマンドに対する応答（ACKなど）
+#define PS2GAP_TESTDONE	10	// リセットコマンドに対する AA
+
+// スキャンコードの途中のバイトは、直前のバイトによって間隔を決める
+static uint8_t scanCodeGap(const uint8_t prev)
+{
+	if (prev == 0xF0)
+		return PS2GAP_BREAK;
+	if (prev == 0xE0 || prev == 0xE1)
+		return PS2GAP_PREFIX;
+	return PS2GAP_CODE;
+}
+
+// 送信バッファ。
+//	データはレコード（１つのスキャンコード、または１つの応答）単位で入れる。レコードは途中で区切ったり、
+//	ほかのレコードを間に挟んだりせずに送信し、送信を中断したときはレコードの先頭から送りなおす。
+//	送信はバイト単位で行い、レコードの最後のバイトを送り終えたらレコードの分をまとめて削除する。
+//	キー入力用（g_Buff）と、ホストのコマンドに対する応答用（g_RespBuff）があり、応答用を先に送る。
+//	データを入れるのはメインループ（あるいは割込み）の一方だけ、取り出すのは他方だけとし、top は入れる側だけが、
+//	btm は取り出す側だけが書き換える。どちらも uint8_t なので1命令で書き換わり、割込みを止めなくてよい。
+//	レコードは全体を書き込んでから top を進めるので、取り出す側から書きかけのレコードは見えない。
+#define RINGBUFF_SIZE		CDC_DATA_OUT_EP_SIZE	// ２のべき乗で128以下であること
+#define RESPBUFF_SIZE		8	// 応答は最大で３バイト（ACK、AB、83）
+#if (RINGBUFF_SIZE & (RINGBUFF_SIZE - 1)) != 0 || 128 < RINGBUFF_SIZE
+#error RINGBUFF_SIZE must be a power of two up to 128
+#endif
+struct RINGENTRY
+{
+	uint8_t dt;
+	unsigned gap : 7;	// 送信前に空ける間隔（PS2GAP_*）
+	unsigned end : 1;	// レコードの最後のバイト
+};
 struct RINGBUFF
 {
-	int top;
-	int btm;
-	int len;
-	uint8_t buff[CDC_DATA_OUT_EP_SIZE*2];
+	volatile uint8_t top;	// 次に入れる位置（マスクせずに進める）
+	volatile uint8_t btm;	// 次に取り出す位置（マスクせずに進める）
+	uint8_t mask;			// 要素数 - 1
+	struct RINGENTRY *buff;
 };
 struct RINGBUFF g_Buff;
+struct RINGBUFF g_RespBuff;
+static struct RINGENTRY g_BuffEnt[RINGBUFF_SIZE];
+static struct RINGENTRY g_RespBuffEnt[RESPBUFF_SIZE];
+
+// バッファへデータを入れる側。満杯で捨てたバイト数を、入れる側ごとに数える
+enum RINGSRC
+{
+	RINGSRC_SCANCODE,	// 'S'コマンド
+	RINGSRC_KEY,		// 'K'コマンド
+	RINGSRC_TYPEMATIC,	// キーリピート
+	RINGSRC_RESPONSE,	// ホストのコマンドに対する応答
+	RINGSRC_NUM
+};
+static uint32_t g_Dropped[RINGSRC_NUM];
 
-void t_InitBuff(struct RINGBUFF *p)
+// size は２のべき乗であること
+void t_InitBuff(struct RINGBUFF *p, struct RINGENTRY *buff, const uint8_t size)
 {
+	p->buff = buff;
+	p->mask = size - 1;
 	p->top = 0;
 	p->btm = 0;
-	p->len = 0;
 	return;
 }
 
-void t_PushBuff(struct RINGBUFF *p, const uint8_t dt)
+static inline uint8_t t_LenBuff(const struct RINGBUFF *p)
 {
-	if( 20 <= p->len )
-		return;
-	p->buff[p->top++] = dt;
-	p->len++;
-	if(p->top == sizeof(p->buff))
-		p->top = 0;
-	return;
+	return (uint8_t)(p->top - p->btm);
 }
-bool t_PopBuff(struct RINGBUFF *p, uint8_t *pDt)
+
+// pDt から len バイトを１つのレコードとして入れる。入りきらない場合は全体を捨て、src の分として数える。
+// 先頭のバイトの前には gap の間隔を空け、２バイト目以降は直前のバイトによって決める。
+bool t_PushRecord(struct RINGBUFF *p, const enum RINGSRC src, const uint8_t *pDt, const uint8_t len, const uint8_t gap)
 {
-	if( p->len == 0 )
+	if( (uint8_t)(p->mask + 1 - t_LenBuff(p)) < len ) {
+		g_Dropped[src] += len;
 		return false;
-	*pDt = p->buff[p->btm];
+	}
+	uint8_t top = p->top;
+	for (uint8_t t = 0; t < len; ++t) {
+		struct RINGENTRY *pEnt = &p->buff[top++ & p->mask];
+		pEnt->dt = pDt[t];
+		pEnt->gap = (t == 0) ? gap : scanCodeGap(pDt[t-1]);
+		pEnt->end = (t == len-1);
+	}
+	p->top = top;
 	return true;
 }
+void t_PushBuff(struct RINGBUFF *p, const enum RINGSRC src, const uint8_t dt, const uint8_t gap)
+{
+	t_PushRecord(p, src, &dt, 1, gap);
+	return;
+}
+// 先頭から ofs 番目のデータを取り出す（バッファからは削除しない）。なければ NULL
+const struct RINGENTRY *t_PeekBuff(struct RINGBUFF *p, const uint8_t ofs)
+{
+	if( t_LenBuff(p) <= ofs )
+		return NULL;
+	return &p->buff[(uint8_t)(p->btm + ofs) & p->mask];
+}
 bool t_DelBtmBuff(struct RINGBUFF *p)
 {
-	if( p->len == 0 )
+	if( t_LenBuff(p) == 0 )
 		return false;
 	p->btm++;
-	p->len--;
-	if(p->btm == sizeof(p->buff))
-		p->btm = 0;
 	return true;
 }
 
+static void setU16(uint8_t *p, const uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	return;
+}
+
+static void setU32(uint8_t *p, const uint32_t v)
+{
+	setU16(&p[0], (uint16_t)v);
+	setU16(&p[2], (uint16_t)(v >> 16));
+	return;
+}
+
+#if defined(APP_LOOP_PROFILE)
+/*********************************************************************
+* メインループ1周の時間（TMR1のカウント、1カウント=2/3us）の統計
+*	ヒストグラムは、[0]:32カウント未満、[1]:64カウント未満 … [7]:2048カウント以上
+*/
+#define LOOPPROF_HIST_NUM	8
+struct LOOPPROF
+{
+	uint16_t lastTick;
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	uint16_t cnt;
+	uint16_t hist[LOOPPROF_HIST_NUM];
+};
+static struct LOOPPROF g_LoopProf;
+
+static void loopProf_Init(void)
+{
+	memset(&g_LoopProf, 0, sizeof(g_LoopProf));
+	g_LoopProf.min = 0xFFFF;
+	g_LoopProf.lastTick = APP_ReadTick();
+	return;
+}
+
+static void loopProf_Add(void)
+{
+	const uint16_t nowTick = APP_ReadTick();
+	const uint16_t period = nowTick - g_LoopProf.lastTick;
+	g_LoopProf.lastTick = nowTick;
+	if (g_LoopProf.cnt == 0xFFFF)
+		return;
+	++g_LoopProf.cnt;
+	g_LoopProf.sum += period;
+	if (period < g_LoopProf.min)
+		g_LoopProf.min = period;
+	if (g_LoopProf.max < period)
+		g_LoopProf.max = period;
+	uint8_t idx = 0;
+	for (uint16_t v = period >> 5; v != 0 && idx < LOOPPROF_HIST_NUM - 1; v >>= 1)
+		++idx;
+	++g_LoopProf.hist[idx];
+	return;
+}
+
+// 'P'コマンドの返信。PC側へ送ったら統計はクリアする
+//	[0]長さ、[1]'P'、[2-3]最小、[4-5]平均、[6-7]最大、[8-]ヒストグラム（すべてリトルエンディアン）
+static void loopProf_Report(void)
+{
+	static uint8_t mess[2 + 2*3 + 2*LOOPPROF_HIST_NUM];
+	mess[0] = sizeof(mess) - 1;
+	mess[1] = 'P';
+	setU16(&mess[2], (g_LoopProf.cnt == 0) ? 0 : g_LoopProf.min);
+	setU16(&mess[4], (g_LoopProf.cnt == 0) ? 0 : (uint16_t)(g_LoopProf.sum / g_LoopProf.cnt));
+	setU16(&mess[6], g_LoopProf.max);
+	for (uint8_t t = 0; t < LOOPPROF_HIST_NUM; ++t)
+		setU16(&mess[8 + t*2], g_LoopProf.hist[t]);
+	putUSBUSART(mess, sizeof(mess));
+	loopProf_Init();
+	return;
+}
+#endif
+
+#if defined(APP_TASK_PROFILE)
+/*********************************************************************
+* 各タスクの処理時間（TMR1のカウント）の統計
+*/
+struct TASKPROF
+{
+	uint16_t max;
+	uint16_t cnt;
+	uint32_t sum;
+};
+static struct TASKPROF g_TaskProf[APP_TASKPROF_NUM];
+
+void APP_TaskProf_Add(const APP_TASKPROF_ID id, const uint16_t beginTick)
+{
+	const uint16_t elapsed = APP_ReadTick() - beginTick;
+	struct TASKPROF *p = &g_TaskProf[id];
+	if (p->cnt == 0xFFFF)
+		return;
+	++p->cnt;
+	p->sum += elapsed;
+	if (p->max < elapsed)
+		p->max = elapsed;
+	return;
+}
+
+// 'C'コマンドの返信。PC側へ送ったら統計はクリアする
+//	[0]長さ、[1]'C'、以降タスクごとに 最大(2)、回数(2)、累計(4)（すべてリトルエンディアン）
+//	タスクの並びは APP_TASKPROF_ID の順
+static void taskProf_Report(void)
+{
+	static uint8_t mess[2 + 8*APP_TASKPROF_NUM];
+	mess[0] = sizeof(mess) - 1;
+	mess[1] = 'C';
+	for (uint8_t t = 0; t < APP_TASKPROF_NUM; ++t) {
+		uint8_t *p = &mess[2 + t*8];
+		setU16(&p[0], g_TaskProf[t].max);
+		setU16(&p[2], g_TaskProf[t].cnt);
+		setU32(&p[4], g_TaskProf[t].sum);
+	}
+	putUSBUSART(mess, sizeof(mess));
+	memset(g_TaskProf, 0, sizeof(g_TaskProf));
+	return;
+}
+#endif
+
+// 'D'コマンドの返信。カウンタはクリアしないので、PC側は前回値との差分を使うこと
+//	[0]長さ、[1]'D'、[2-5]PS/2へ送信したキー入力のバイト数（送信禁止で送りなおした分と、ホストのコマンドへの
+//	応答は数えない）、[6-9]送信バッファが満杯で捨てたバイト数の合計、
+//	[10-]入れる側ごとの捨てたバイト数（RINGSRC_* の順に4バイトずつ）。値はリトルエンディアン
+static void countReport(void)
+{
+	static uint8_t mess[2 + 4*2 + 4*RINGSRC_NUM];
+	mess[0] = sizeof(mess) - 1;
+	mess[1] = 'D';
+	setU32(&mess[2], g_SentCnt);
+	uint32_t total = 0;
+	for (uint8_t t = 0; t < RINGSRC_NUM; ++t) {
+		total += g_Dropped[t];
+		setU32(&mess[10 + t*4], g_Dropped[t]);
+	}
+	setU32(&mess[6], total);
+	putUSBUSART(mess, sizeof(mess));
+	return;
+}
+
+// ホストのコマンドで設定されるキーボードの状態
+struct KBDSTATE
+{
+	uint8_t scanSet;	// スキャンコードセット（1〜3）
+	uint8_t typematic;	// リピートの設定（PS2CMD_TYPEMATICの引数。bit6-5 遅延、bit4-0 速度）
+	bool enabled;		// false のときはスキャンコードを送らない
+};
+static struct KBDSTATE g_Kbd = {2, 0x2b, true};
+
+// 'S'コマンドで受け取ったスキャンコード（g_Kbd.scanSet のセット）を、１つのスキャンコードの分ずつ
+// レコードにまとめる。スキャンコードがパケットをまたいだ場合は、残りを受け取るまでバッファへ入れずに持っておく。
+// Pause はセット1（E1 1D 45 E1 9D C5）、セット2（E1 14 77 E1 F0 14 F0 77）とも、'K'と同じく全体を１つのレコードにする。
+struct KEYREC
+{
+	uint8_t set;		// まとめているセット。g_Kbd.scanSet が変わったら途中のコードは捨てる
+	uint8_t len;
+	uint8_t more;		// Pause の最初の E1 の後、まだ続くコードの数（２つ目の E1 とプレフィックスは数えない）
+	uint8_t dt[8];
+};
+static struct KEYREC g_KeyRec;
+
+static void keyRec_Flush(void)
+{
+	t_PushRecord(&g_Buff, RINGSRC_SCANCODE, g_KeyRec.dt, g_KeyRec.len, PS2GAP_CODE);
+	g_KeyRec.len = 0;
+	g_KeyRec.more = 0;
+	return;
+}
+
+static void keyRec_Add(const uint8_t dt)
+{
+	const uint8_t set = g_Kbd.scanSet;
+	if (g_KeyRec.set != set) {
+		g_KeyRec.set = set;
+		g_KeyRec.len = 0;
+		g_KeyRec.more = 0;
+	}
+	g_KeyRec.dt[g_KeyRec.len++] = dt;
+	if (dt == 0xE1 && set != 3) {
+		if (g_KeyRec.len == 1)
+			g_KeyRec.more = 3;	// Pause は E1 の後にコードが２つ、E1 の後にまたコードが２つ続く
+	}
+	else if (!isScanCodePrefix(set, dt)) {
+		if (g_KeyRec.more == 0) {
+			keyRec_Flush();
+			return;
+		}
+		--g_KeyRec.more;
+	}
+	if (g_KeyRec.len == sizeof(g_KeyRec.dt))	// 長すぎるものはそこで区切る
+		keyRec_Flush();
+	return;
+}
+
+/*********************************************************************
+* キーリピート（タイプマティック）
+*	'T'コマンドで有効にすると、最後に押されたキーのメイクコードを g_Kbd.typematic の遅延と間隔で
+*	繰り返し送信する。PC側はキーを押したときと離したときのスキャンコードだけを送ればよい。
+*/
+struct TYPEMATIC
+{
+	bool enabled;		// 'T'コマンドで設定する
+	uint8_t prefix;		// 押されているキーのプレフィックス（E0）。なければ 0
+	uint8_t code;		// 押されているキーのコード。なければ 0
+	uint16_t wait100us;	// 次のリピートまでの時間
+};
+static struct TYPEMATIC g_Typematic;
+
+// g_Kbd.typematic のbit6-5から、最初のリピートまでの時間（100us単位）を求める
+static uint16_t typematicDelay(void)
+{
+	return (uint16_t)(((g_Kbd.typematic >> 5) & 0x03) + 1) * 2500;	// 250ms〜1s
+}
+
+// g_Kbd.typematic のbit4-0から、リピートの間隔（100us単位）を求める
+//	間隔 = (8 + bit2-0) * 2^(bit4-3) * 4.17ms
+static uint16_t typematicPeriod(void)
+{
+	const uint16_t a = 8 + (g_Kbd.typematic & 0x07);
+	return (uint16_t)(((uint32_t)(a << ((g_Kbd.typematic >> 3) & 0x03)) * 417) / 10);
+}
+
+static void typematic_Stop(void)
+{
+	g_Typematic.code = 0;
+	return;
+}
+
+// prefix、code のメイクコードのキーが押された。このキーをリピートする
+static void typematic_Press(const uint8_t prefix, const uint8_t code)
+{
+	g_Typematic.prefix = prefix;
+	g_Typematic.code = code;
+	g_Typematic.wait100us = typematicDelay();
+	g_Repeat100us = 0;
+	return;
+}
+
+// prefix、code のメイクコードのキーが離された
+static void typematic_Release(const uint8_t prefix, const uint8_t code)
+{
+	if (g_Typematic.prefix == prefix && g_Typematic.code == code)
+		typematic_Stop();	// ほかのキーを離したときはリピートを続ける
+	return;
+}
+
+// 'S'コマンドのスキャンコードを解析している途中の状態（typematic_Track()）
+struct TYPEMATICTRACK
+{
+	uint8_t set;		// 解析しているセット。g_Kbd.scanSet が変わったら途中の状態は捨てる
+	uint8_t prefix;		// 受け取ったプレフィックス（E0）
+	bool bBreak;		// F0 を受け取った（セット2、3）
+	uint8_t skip;		// 読み飛ばすバイト数（Pause）
+};
+static struct TYPEMATICTRACK g_TypematicTrack;
+
+// PCから受け取ったスキャンコード（g_Kbd.scanSet のセット）を１バイトずつ渡し、最後に押されたキーを調べる
+//	セット1	: E0 がプレフィックス、ブレークコードはメイクコードのbit7を立てたもの
+//	セット2	: E0 がプレフィックス、F0 の後がブレークコード
+//	セット3	: プレフィックスはなく、F0 の後がブレークコード
+static void typematic_Track(const uint8_t dt)
+{
+	struct TYPEMATICTRACK *p = &g_TypematicTrack;
+	const uint8_t set = g_Kbd.scanSet;
+	if (p->set != set) {
+		p->set = set;
+		p->prefix = 0;
+		p->bBreak = false;
+		p->skip = 0;
+	}
+	if (0 < p->skip) {
+		--p->skip;
+		return;
+	}
+	if (set != 3) {
+		if (dt == 0xE0) {
+			p->prefix = dt;
+			return;
+		}
+		if (dt == 0xE1) {
+			// Pause（セット1 E1 1D 45 E1 9D C5、セット2 E1 14 77 E1 F0 14 F0 77）はリピートしない。
+			// 押すとリピートは止まる
+			p->skip = (set == 1) ? 5 : 7;
+			typematic_Stop();
+			return;
+		}
+	}
+	uint8_t code = dt;
+	bool bBreak;
+	if (set == 1) {
+		bBreak = (dt & 0x80) != 0;
+		code = dt & 0x7f;
+	}
+	else {
+		if (dt == 0xF0) {
+			p->bBreak = true;
+			return;
+		}
+		bBreak = p->bBreak;
+	}
+	if (!bBreak)
+		typematic_Press(p->prefix, code);
+	else
+		typematic_Release(p->prefix, code);
+	p->prefix = 0;
+	p->bBreak = false;
+	return;
+}
+
+static void taskTypematic()
+{
+	if (!g_Typematic.enabled || g_Typematic.code == 0 || !g_Kbd.enabled)
+		return;
+	if (g_Repeat100us < g_Typematic.wait100us)
+		return;
+	// 次のリピートは今回の予定時刻から数える（メインループの遅れで間隔がばらつかないようにする）
+	g_Repeat100us -= g_Typematic.wait100us;
+	g_Typematic.wait100us = typematicPeriod();
+	if (g_Typematic.wait100us <= g_Repeat100us)
+		g_Repeat100us = 0;
+	// 前のデータを送りきれていないときは、リピートをためずに間引く
+	if (t_LenBuff(&g_Buff) != 0)
+		return;
+	if (g_Typematic.prefix != 0) {
+		const uint8_t rec[] = {g_Typematic.prefix, g_Typematic.code};
+		t_PushRecord(&g_Buff, RINGSRC_TYPEMATIC, rec, sizeof(rec), PS2GAP_CODE);
+	}
+	else {
+		t_PushBuff(&g_Buff, RINGSRC_TYPEMATIC, g_Typematic.code, PS2GAP_CODE);
+	}
+	return;
+}
+
+/*********************************************************************
+* スキャンコードの変換
+*	'K'コマンドで受け取ったキー番号を、ホストが PS2CMD_SCANSET で選んだセットのスキャンコードにする。
+*	キー番号は KEYMAP[] の並び（日本語109キーボードの左上から）。
+*	KEY_EXT は、セット1、2でE0を前に付けるキー。セット3にはE0がない。
+*/
+#define KEY_EXT			0x80	// KEYMAP[].set1 の bit7
+#define KEY_PRINTSCREEN	79
+#define KEY_PAUSE		81
+
+struct KEYCODE
+{
+	uint8_t set1;	// bit7 は KEY_EXT
+	uint8_t set2;
+	uint8_t set3;
+};
+static const struct KEYCODE KEYMAP[] =
+{
+	{0x01, 0x76, 0x08},	//   0 Esc
+	{0x3B, 0x05, 0x07},	//   1 F1
+	{0x3C, 0x06, 0x0F},	//   2 F2
+	{0x3D, 0x04, 0x17},	//   3 F3
+	{0x3E, 0x0C, 0x1F},	//   4 F4
+	{0x3F, 0x03, 0x27},	//   5 F5
+	{0x40, 0x0B, 0x2F},	//   6 F6
+	{0x41, 0x83, 0x37},	//   7 F7
+	{0x42, 0x0A, 0x3F},	//   8 F8
+	{0x43, 0x01, 0x47},	//   9 F9
+	{0x44, 0x09, 0x4F},	//  10 F10
+	{0x57, 0x78, 0x56},	//  11 F11
+	{0x58, 0x07, 0x5E},	//  12 F12
+	{0x29, 0x0E, 0x0E},	//  13 半角/全角 `
+	{0x02, 0x16, 0x16},	//  14 1
+	{0x03, 0x1E, 0x1E},	//  15 2
+	{0x04, 0x26, 0x26},	//  16 3
+	{0x05, 0x25, 0x25},	//  17 4
+	{0x06, 0x2E, 0x2E},	//  18 5
+	{0x07, 0x36, 0x36},	//  19 6
+	{0x08, 0x3D, 0x3D},	//  20 7
+	{0x09, 0x3E, 0x3E},	//  21 8
+	{0x0A, 0x46, 0x46},	//  22 9
+	{0x0B, 0x45, 0x45},	//  23 0
+	{0x0C, 0x4E, 0x4E},	//  24 -
+	{0x0D, 0x55, 0x55},	//  25 ^ =
+	{0x7D, 0x6A, 0x5D},	//  26 ￥
+	{0x0E, 0x66, 0x66},	//  27 BackSpace
+	{0x0F, 0x0D, 0x0D},	//  28 Tab
+	{0x10, 0x15, 0x15},	//  29 Q
+	{0x11, 0x1D, 0x1D},	//  30 W
+	{0x12, 0x24, 0x24},	//  31 E
+	{0x13, 0x2D, 0x2D},	//  32 R
+	{0x14, 0x2C, 0x2C},	//  33 T
+	{0x15, 0x35, 0x35},	//  34 Y
+	{0x16, 0x3C, 0x3C},	//  35 U
+	{0x17, 0x43, 0x43},	//  36 I
+	{0x18, 0x44, 0x44},	//  37 O
+	{0x19, 0x4D, 0x4D},	//  38 P
+	{0x1A, 0x54, 0x54},	//  39 @ [
+	{0x1B, 0x5B, 0x5B},	//  40 [ ]
+	{0x1C, 0x5A, 0x5A},	//  41 Enter
+	{0x3A, 0x58, 0x14},	//  42 CapsLock
+	{0x1E, 0x1C, 0x1C},	//  43 A
+	{0x1F, 0x1B, 0x1B},	//  44 S
+	{0x20, 0x23, 0x23},	//  45 D
+	{0x21, 0x2B, 0x2B},	//  46 F
+	{0x22, 0x34, 0x34},	//  47 G
+	{0x23, 0x33, 0x33},	//  48 H
+	{0x24, 0x3B, 0x3B},	//  49 J
+	{0x25, 0x42, 0x42},	//  50 K
+	{0x26, 0x4B, 0x4B},	//  51 L
+	{0x27, 0x4C, 0x4C},	//  52 ; ;
+	{0x28, 0x52, 0x52},	//  53 : '
+	{0x2B, 0x5D, 0x5C},	//  54 ] ＼
+	{0x2A, 0x12, 0x12},	//  55 左Shift
+	{0x2C, 0x1A, 0x1A},	//  56 Z
+	{0x2D, 0x22, 0x22},	//  57 X
+	{0x2E, 0x21, 0x21},	//  58 C
+	{0x2F, 0x2A, 0x2A},	//  59 V
+	{0x30, 0x32, 0x32},	//  60 B
+	{0x31, 0x31, 0x31},	//  61 N
+	{0x32, 0x3A, 0x3A},	//  62 M
+	{0x33, 0x41, 0x41},	//  63 ,
+	{0x34, 0x49, 0x49},	//  64 .
+	{0x35, 0x4A, 0x4A},	//  65 /
+	{0x73, 0x51, 0x51},	//  66 ろ
+	{0x36, 0x59, 0x59},	//  67 右Shift
+	{0x1D, 0x14, 0x11},	//  68 左Ctrl
+	{0xDB, 0x1F, 0x8B},	//  69 左Windows
+	{0x38, 0x11, 0x19},	//  70 左Alt
+	{0x7B, 0x67, 0x85},	//  71 無変換
+	{0x39, 0x29, 0x29},	//  72 Space
+	{0x79, 0x64, 0x86},	//  73 変換
+	{0x70, 0x13, 0x87},	//  74 カタカナ
+	{0xB8, 0x11, 0x39},	//  75 右Alt
+	{0xDC, 0x27, 0x8C},	//  76 右Windows
+	{0xDD, 0x2F, 0x8D},	//  77 Menu
+	{0x9D, 0x14, 0x58},	//  78 右Ctrl
+	{0xB7, 0x7C, 0x57},	//  79 PrintScreen
+	{0x46, 0x7E, 0x5F},	//  80 ScrollLock
+	{0x45, 0x77, 0x62},	//  81 Pause
+	{0xD2, 0x70, 0x67},	//  82 Insert
+	{0xC7, 0x6C, 0x6E},	//  83 Home
+	{0xC9, 0x7D, 0x6F},	//  84 PageUp
+	{0xD3, 0x71, 0x64},	//  85 Delete
+	{0xCF, 0x69, 0x65},	//  86 End
+	{0xD1, 0x7A, 0x6D},	//  87 PageDown
+	{0xC8, 0x75, 0x63},	//  88 ↑
+	{0xCB, 0x6B, 0x61},	//  89 ←
+	{0xD0, 0x72, 0x60},	//  90 ↓
+	{0xCD, 0x74, 0x6A},	//  91 →
+	{0x45, 0x77, 0x76},	//  92 NumLock
+	{0xB5, 0x4A, 0x77},	//  93 テンキー /
+	{0x37, 0x7C, 0x7E},	//  94 テンキー *
+	{0x4A, 0x7B, 0x84},	//  95 テンキー -
+	{0x47, 0x6C, 0x6C},	//  96 テンキー 7
+	{0x48, 0x75, 0x75},	//  97 テンキー 8
+	{0x49, 0x7D, 0x7D},	//  98 テンキー 9
+	{0x4E, 0x79, 0x7C},	//  99 テンキー +
+	{0x4B, 0x6B, 0x6B},	// 100 テンキー 4
+	{0x4C, 0x73, 0x73},	// 101 テンキー 5
+	{0x4D, 0x74, 0x74},	// 102 テンキー 6
+	{0x4F, 0x69, 0x69},	// 103 テンキー 1
+	{0x50, 0x72, 0x72},	// 104 テンキー 2
+	{0x51, 0x7A, 0x7A},	// 105 テンキー 3
+	{0x9C, 0x5A, 0x79},	// 106 テンキー Enter
+	{0x52, 0x70, 0x70},	// 107 テンキー 0
+	{0x53, 0x71, 0x71},	// 108 テンキー .
+};
+#define KEYMAP_NUM	(sizeof(KEYMAP) / sizeof(KEYMAP[0]))
+
+// キー番号 key を押した（bBreak=false）、離した（bBreak=true）ときのスキャンコードをバッファへ入れる
+static void pushKey(const uint8_t key, const bool bBreak)
+{
+	if (KEYMAP_NUM <= key)
+		return;
+	const struct KEYCODE *p = &KEYMAP[key];
+	const uint8_t set = g_Kbd.scanSet;
+	if (key == KEY_PAUSE && set != 3) {
+		// Pauseは押したときにブレークコードまで送り、離したときは何も送らない
+		static const uint8_t PAUSE1[] = {0xE1, 0x1D, 0x45, 0xE1, 0x9D, 0xC5};
+		static const uint8_t PAUSE2[] = {0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77};
+		if (!bBreak) {
+			if (set == 1)
+				t_PushRecord(&g_Buff, RINGSRC_KEY, PAUSE1, sizeof(PAUSE1), PS2GAP_CODE);
+			else
+				t_PushRecord(&g_Buff, RINGSRC_KEY, PAUSE2, sizeof(PAUSE2), PS2GAP_CODE);
+			typematic_Stop();
+		}
+		return;
+	}
+	uint8_t prefix = 0;
+	uint8_t code;
+	if (set == 3) {
+		code = p->set3;
+	}
+	else {
+		if (p->set1 & KEY_EXT)
+			prefix = 0xE0;
+		code = (set == 1) ? (p->set1 & ~KEY_EXT) : p->set2;
+	}
+	// PrintScreenは、セット1、2では前後に偽のShiftを付ける（E0 2A E0 37、E0 12 E0 7C）
+	const bool bFakeShift = (key == KEY_PRINTSCREEN && set != 3);
+	const uint8_t shift = (set == 1) ? 0x2A : 0x12;
+	uint8_t rec[8];
+	uint8_t n = 0;
+	if (!bBreak) {
+		if (bFakeShift) {
+			rec[n++] = 0xE0;
+			rec[n++] = shift;
+		}
+		if (prefix != 0)
+			rec[n++] = prefix;
+		rec[n++] = code;
+		typematic_Press(prefix, code);
+	}
+	else {
+		if (prefix != 0)
+			rec[n++] = prefix;
+		if (set == 1) {
+			rec[n++] = code | 0x80;
+		}
+		else {
+			rec[n++] = 0xF0;
+			rec[n++] = code;
+		}
+		if (bFakeShift) {
+			rec[n++] = 0xE0;
+			if (set == 1) {
+				rec[n++] = shift | 0x80;
+			}
+			else {
+				rec[n++] = 0xF0;
+				rec[n++] = shift;
+			}
+		}
+		typematic_Release(prefix, code);
+	}
+	t_PushRecord(&g_Buff, RINGSRC_KEY, rec, n, PS2GAP_CODE);
+	return;
+}
+
+// PS2CMD_DEFAULT、PS2CMD_DISABLEで初期値に戻す（スキャンコードセットはそのまま）
+static void kbd_SetDefault(void)
+{
+	g_Kbd.typematic = 0x2b;		// 500ms、10.9回/s
+	g_Kbd.enabled = true;
+	typematic_Stop();
+	return;
+}
+
+/*********************************************************************
+* 送信バッファの空き（クレジット）の通知
+*	'F'コマンドで有効にすると、送信バッファ（g_Buff）の空きが変わるたびに [3]'F'、[2]空きバイト数、
+*	[3]処理し終えた'S'、'K'コマンドのパケット数（下位8ビット）をPC側へ送る。
+*	PC側は、空きバイト数から、このパケット数より後に送ったパケットの分を引いた分だけ送ってよい。
+*	'S'は１バイトにつき１、'K'は１つのキーにつき変換後のスキャンコードのバイト数（最大8）を使う。
+*/
+struct CREDIT
+{
+	bool enabled;
+	bool bReq;			// 変化していなくても通知する
+	uint8_t lastFree;	// 最後に通知した空きバイト数
+	uint8_t rxCnt;		// 処理し終えた'S'、'K'コマンドのパケット数
+};
+static struct CREDIT g_Credit;
+
+// 送信バッファの空き。まだレコードにしていない'S'のバイトも使用中として数える
+// （バッファが満杯のときにまとめかけのバイトがあると、使用中の方が大きくなる）
+static uint8_t creditFree(void)
+{
+	const uint8_t used = t_LenBuff(&g_Buff) + g_KeyRec.len;
+	return (RINGBUFF_SIZE <= used) ? 0 : (uint8_t)(RINGBUFF_SIZE - used);
+}
+
+// 空きが変わっていたら通知する。@return 送ったか
+// USBの送信が空いているとき（usbSendPending()）だけ呼ぶこと
+static bool creditReport(void)
+{
+	const uint8_t freeBytes = creditFree();
+	if (!g_Credit.enabled || (!g_Credit.bReq && freeBytes == g_Credit.lastFree))
+		return false;
+	static uint8_t mess[4];
+	mess[0] = 3;
+	mess[1] = 'F';
+	mess[2] = freeBytes;
+	mess[3] = g_Credit.rxCnt;
+	putUSBUSART(mess, sizeof(mess));
+	g_Credit.lastFree = freeBytes;
+	g_Credit.bReq = false;
+	return true;
+}
+
+/*********************************************************************
+* PC側へのメッセージ（IN）
+*	putUSBUSART() は、前のメッセージを送り終えていない（USBUSARTIsTxTrfReady() が false）と何もせずに
+*	捨ててしまう。そこでメッセージはその場では送らず、返信は種類ごとのフラグ（g_UsbReq）に、
+*	ホストのコマンドの通知は列（g_HostCmdQueue）に入れておき、usbSendPending() が送れるときに１つずつ送る。
+*	優先順位は、ホストのコマンドの通知、返信、クレジットの順。返信の中身は送るときに作る。
+*/
+enum USBREQ
+{
+	USBREQ_INFO			= 0x01,	// 'I'、SX-2側の電源状態の変化
+	USBREQ_TYPEMATIC	= 0x02,	// 'T'
+	USBREQ_CLOCK		= 0x04,	// 'R'
+	USBREQ_COUNT		= 0x08,	// 'D'
+	USBREQ_LOOPPROF		= 0x10,	// 'P'
+	USBREQ_TASKPROF		= 0x20,	// 'C'
+};
+static uint8_t g_UsbReq;		// 送っていない返信（USBREQ_* の論理和）
+
+// ホストから受信したコマンドの通知。ホストのコマンドは1msに１つも届かないので、ふつうはあふれない。
+// あふれたときは新しい方を捨てる
+#define HOSTCMDQ_SIZE		8	// ２のべき乗であること
+struct HOSTCMDNOTIFY
+{
+	uint8_t len;		// 1:コマンドだけ、2:引数あり
+	uint8_t cmd;
+	uint8_t arg;
+};
+static struct HOSTCMDNOTIFY g_HostCmdQueue[HOSTCMDQ_SIZE];
+static uint8_t g_HostCmdTop = 0;	// 次に入れる位置
+static uint8_t g_HostCmdBtm = 0;	// 次に送る位置
+
+// 'I'の返信、およびSX-2側の電源状態の変化の通知
+static void infoReport(void)
+{
+	static uint8_t mess[] = "\x9PS2USB:00";
+	mess[9] = '0' + ps2powsts;
+	putUSBUSART(mess, sizeof(mess)-1);		// -1 は文字列終端の分
+	return;
+}
+
+// 'T'の返信。[1]'T'、[2]設定値
+static void typematicReport(void)
+{
+	static uint8_t mess[3];
+	mess[0] = 2;
+	mess[1] = 'T';
+	mess[2] = g_Typematic.enabled;
+	putUSBUSART(mess, sizeof(mess));
+	return;
+}
+
+// 'R'の返信。[1]'R'、[2]CLKの周期（us）、[3]ラインが落ち着くまでの待ち時間（us）
+static void clockReport(void)
+{
+	static uint8_t mess[4];
+	mess[0] = 3;
+	mess[1] = 'R';
+	mess[2] = g_Ps2Tx.clkPeriodUs;
+	mess[3] = g_SettleUs;
+	putUSBUSART(mess, sizeof(mess));
+	return;
+}
+
+// ホストから受信したコマンドの通知を１つ送る。[1]コマンド、[2]引数（引数があるときだけ）
+static void hostCmdReport(void)
+{
+	static uint8_t mess[3];	// putUSBUSARTに渡すポインタはstatic領域であること。
+	const struct HOSTCMDNOTIFY *p = &g_HostCmdQueue[g_HostCmdBtm];
+	mess[0] = p->len;
+	mess[1] = p->cmd;
+	mess[2] = p->arg;
+	putUSBUSART(mess, p->len + 1);
+	g_HostCmdBtm = (g_HostCmdBtm + 1) & (HOSTCMDQ_SIZE - 1);
+	return;
+}
+
+// 送っていないメッセージがあれば、優先順位の高いものを１つ送る
+static void usbSendPending(void)
+{
+	if (!USBUSARTIsTxTrfReady())
+		return;
+	if (g_HostCmdBtm != g_HostCmdTop) {
+		hostCmdReport();
+		return;
+	}
+	// 返信はビットの低い方から
+	const uint8_t req = g_UsbReq & (uint8_t)-g_UsbReq;
+	g_UsbReq &= (uint8_t)~req;
+	switch (req)
+	{
+		case USBREQ_INFO:		infoReport();		return;
+		case USBREQ_TYPEMATIC:	typematicReport();	return;
+		case USBREQ_CLOCK:		clockReport();		return;
+		case USBREQ_COUNT:		countReport();		return;
+#if defined(APP_LOOP_PROFILE)
+		case USBREQ_LOOPPROF:	loopProf_Report();	return;
+#endif
+#if defined(APP_TASK_PROFILE)
+		case USBREQ_TASKPROF:	taskProf_Report();	return;
+#endif
+	}
+	creditReport();
+	return;
+}
+
 static void taskUSB()
 {
 	// USBからの受信
-	bool bReqInfo = false;
-	static uint8_t usbReadBuff[CDC_DATA_OUT_EP_SIZE];
-	const int numBytes = getsUSBUSART(usbReadBuff, sizeof(usbReadBuff));
-	if( 0 < numBytes)
+	// エンドポイントのバッファをコピーせずにそのまま解析し、終わったら CDCRxReleasePacket() で返す
+	uint8_t numBytes;
+	volatile uint8_t *usbReadBuff = CDCRxGetPacket(&numBytes);
+	if( usbReadBuff != NULL && 0 < numBytes)
 	{
+		PS2_PROBE_USB_RX(usbReadBuff, numBytes);
 		switch( usbReadBuff[0] ){
 			case 'I':
 			{
-				bReqInfo = true;
+				g_UsbReq |= USBREQ_INFO;
 				break;
 			}
 			case 'S':
 			{
+				// スキャンコードをそのまま送る。ホストが選んだセット（g_Kbd.scanSet）のコードであること
+				++g_Credit.rxCnt;
+				if (!g_Kbd.enabled)	// ホストがスキャンを止めている
+					break;
 				for(int t = 1; t < numBytes; ++t) {
-					t_PushBuff(&g_Buff, usbReadBuff[t]); 
+					keyRec_Add(usbReadBuff[t]);
+					typematic_Track(usbReadBuff[t]);
+				}
+				break;
+			}
+			case 'K':
+			{
+				// キー番号をホストが選んだセットのスキャンコードにして送る。
+				// [1]以降の各バイトは、bit7 0=押した、1=離した、bit6-0 キー番号（KEYMAP[]）
+				++g_Credit.rxCnt;
+				if (!g_Kbd.enabled)
+					break;
+				for(int t = 1; t < numBytes; ++t)
+					pushKey(usbReadBuff[t] & 0x7f, (usbReadBuff[t] & 0x80) != 0);
+				break;
+			}
+			case 'F':
+			{
+				// クレジットの通知を設定する。[1]0=通知しない、1=通知する。省略したら設定は変えない
+				// どちらの場合も、有効なら現在の空きをすぐに通知する
+				if (2 <= numBytes)
+					g_Credit.enabled = (usbReadBuff[1] != 0);
+				g_Credit.bReq = true;
+				break;
+			}
+			case 'D':
+			{
+				g_UsbReq |= USBREQ_COUNT;
+				break;
+			}
+			case 'T':
+			{
+				// キーリピートをこちらで行うかどうかを設定する。[1]0=PC側で行う、1=こちらで行う
+				// 省略したら現在の値を返すだけ。返信は [1]'T'、[2]設定値
+				if (2 <= numBytes) {
+					g_Typematic.enabled = (usbReadBuff[1] != 0);
+					typematic_Stop();
 				}
-				g_WaitCnt100us = 0;
-				g_WaitCnt100usTarget = 10;
+				g_UsbReq |= USBREQ_TYPEMATIC;
 				break;
 			}
+			case 'R':
+			{
+				// 送信時のCLKの周期を設定する。[1]周期（us）。省略したら現在の値を返すだけ
+				// 返信は [1]'R'、[2]CLKの周期（us）、[3]ラインが落ち着くまでの待ち時間（us）
+				if (2 <= numBytes)
+					ps2tx_SetClockPeriod(usbReadBuff[1]);
+				g_UsbReq |= USBREQ_CLOCK;
+				break;
+			}
+#if defined(APP_LOOP_PROFILE)
+			case 'P':
+			{
+				g_UsbReq |= USBREQ_LOOPPROF;
+				break;
+			}
+#endif
+#if defined(APP_TASK_PROFILE)
+			case 'C':
+			{
+				g_UsbReq |= USBREQ_TASKPROF;
+				break;
+			}
+#endif
 		}
 	}
+	if (usbReadBuff != NULL)
+		CDCRxReleasePacket();
 	
 	// SX-2側の電源状態が変化したらそれをPC側に通知する
 	if( ps2powsts != PS2POW_IN() ){
 		ps2powsts = PS2POW_IN();
-		bReqInfo = true;
+		g_UsbReq |= USBREQ_INFO;
+		// ホストの電源が入ったらラインの立ち上がり時間を測りなおす（切れたときはラインが上がらないので測らない）
+		if (ps2powsts)
+			g_bReqCalib = true;
 	}
 
-	if (bReqInfo){
-		static uint8_t mess[] = "\x9PS2USB:00";
-		mess[9] = '0' + ps2powsts;
-		putUSBUSART(mess, sizeof(mess)-1);		// -1 は文字列終端の分
-	}
+	usbSendPending();
 	return;
 }
 
 // PS/2 command.
 enum PS2CMD
 {
+	PS2CMD_NONE		= 0x00,	// 引数を待っていない
 	PS2CMD_TEST		= 0xFF,
+	PS2CMD_RESEND	= 0xfe,
+	PS2CMD_SET3KEYMAKE			= 0xFD,	// 以下３つはキー番号を引数に取る（コマンドを受信するまで続く）
+	PS2CMD_SET3KEYMAKEBREAK		= 0xFC,
+	PS2CMD_SET3KEYTYPEMATIC		= 0xFB,
+	PS2CMD_SET3ALLTYPEMATICMAKEBREAK = 0xFA,	// 以下４つは引数なし
+	PS2CMD_SET3ALLMAKE			= 0xF9,
+	PS2CMD_SET3ALLMAKEBREAK		= 0xF8,
+	PS2CMD_SET3ALLTYPEMATIC		= 0xF7,
+	PS2CMD_DEFAULT	= 0xF6,
+	PS2CMD_DISABLE	= 0xF5,
+	PS2CMD_ENABLE	= 0xF4,
+	PS2CMD_TYPEMATIC= 0xF3,
+	PS2CMD_IDREAD	= 0xF2,
+	PS2CMD_SCANSET	= 0xF0,
 	PS2CMD_ECHO		= 0xEE,
 	PS2CMD_LED		= 0xED,
-	PS2CMD_IDREAD	= 0xF2,
 	PS2CMD_ACK		= 0xFA,
 	PS2CMD_TESTDONE	= 0xAA,
-	PS2CMD_RESEND	= 0xfe,
+	PS2CMD_ID1		= 0xAB,	// IDREADに対する返信（MF2キーボード）
+	PS2CMD_ID2		= 0x83,
 };
 
-void tasksub_ReceiveData(const uint8_t data, bool *pbWaitLed, enum PS2CMD *pLastData)
+// ホストから受信したコマンドをPC側へ通知する（usbSendPending() が送る）。len 1:コマンドだけ、2:引数あり
+static void notifyHostCmd(const uint8_t len, const uint8_t cmd, const uint8_t arg)
+{
+	const uint8_t next = (g_HostCmdTop + 1) & (HOSTCMDQ_SIZE - 1);
+	if (next == g_HostCmdBtm)
+		return;
+	struct HOSTCMDNOTIFY *p = &g_HostCmdQueue[g_HostCmdTop];
+	p->len = len;
+	p->cmd = cmd;
+	p->arg = arg;
+	g_HostCmdTop = next;
+	return;
+}
+
+static void pushResponse(const uint8_t dt)
+{
+	t_PushBuff(&g_RespBuff, RINGSRC_RESPONSE, dt, PS2GAP_RESPONSE);
+	return;
+}
+
+// 引数を取るコマンドの、引数を受信したときの処理
+void tasksub_ReceiveArg(const enum PS2CMD cmd, const uint8_t data, enum PS2CMD *pWaitArg)
+{
+	*pWaitArg = PS2CMD_NONE;
+	switch(cmd)
+	{
+		case PS2CMD_SCANSET:
+		{
+			// 0 なら現在のセット番号を返す。1〜3 ならそのセットに切り替える
+			if (3 < data) {
+				pushResponse(PS2CMD_RESEND);
+				*pWaitArg = cmd;
+				return;
+			}
+			pushResponse(PS2CMD_ACK);
+			if (data == 0)
+				pushResponse(g_Kbd.scanSet);
+			else {
+				g_Kbd.scanSet = data;
+				typematic_Stop();	// リピート中のコードは前のセットのもの
+			}
+			break;
+		}
+		case PS2CMD_TYPEMATIC:
+		{
+			pushResponse(PS2CMD_ACK);
+			g_Kbd.typematic = data & 0x7f;
+			break;
+		}
+		case PS2CMD_SET3KEYMAKE:
+		case PS2CMD_SET3KEYMAKEBREAK:
+		case PS2CMD_SET3KEYTYPEMATIC:
+		{
+			pushResponse(PS2CMD_ACK);
+			*pWaitArg = cmd;	// 次のコマンドまでキー番号が続く
+			break;
+		}
+		default:	// PS2CMD_LED
+		{
+			pushResponse(PS2CMD_ACK);
+			break;
+		}
+	}
+	notifyHostCmd(2, cmd, data);
+	return;
+}
+
+// bRecRestart : 送信途中のレコードがあり、応答の後で最初から送りなおす
+void tasksub_ReceiveData(const uint8_t data, enum PS2CMD *pWaitArg, const bool bRecRestart)
 {
 	switch(data)
 	{
 		case PS2CMD_LED:
+		case PS2CMD_SCANSET:
+		case PS2CMD_TYPEMATIC:
+		case PS2CMD_SET3KEYMAKE:
+		case PS2CMD_SET3KEYMAKEBREAK:
+		case PS2CMD_SET3KEYTYPEMATIC:
 		{
-			t_PushBuff(&g_Buff, *pLastData=PS2CMD_ACK);
-			g_WaitCnt100us = 0;
-			g_WaitCnt100usTarget = 4;
-			*pbWaitLed = true;
-			break;
+			pushResponse(PS2CMD_ACK);
+			*pWaitArg = (enum PS2CMD)data;
+			return;		// 引数を受信してから通知する
 		}
 		case PS2CMD_TEST:
 		{
-			t_PushBuff(&g_Buff, *pLastData=PS2CMD_TESTDONE);
-			static uint8_t mess[2];
-			mess[0] = 1;
-			mess[1] = data;
-			putUSBUSART(mess, sizeof(mess));	// putUSBUSARTに渡すポインタはstatic領域であること。
-			g_WaitCnt100us = 0;
-			g_WaitCnt100usTarget = 10;
-
-// リファクタリングと、
-// CLH=H、DAT=Lでも受信を開始する処理を追加する。
-
+			pushResponse(PS2CMD_ACK);
+			t_PushBuff(&g_RespBuff, RINGSRC_RESPONSE, PS2CMD_TESTDONE, PS2GAP_TESTDONE);
+			kbd_SetDefault();
+			g_Kbd.scanSet = 2;
 			break;
 		}
 		case PS2CMD_ECHO:
 		{
-			t_PushBuff(&g_Buff, *pLastData=PS2CMD_ECHO);
-			break;
+			pushResponse(PS2CMD_ECHO);
+			return;
 		}
 		case PS2CMD_IDREAD:
 		{
-			t_PushBuff(&g_Buff, *pLastData=PS2CMD_ACK);
-			g_WaitCnt100us = 0;
-			g_WaitCnt100usTarget = 4;
-			static uint8_t mess[2];
-			mess[0] = 1;
-			mess[1] = data;
-			putUSBUSART(mess, sizeof(mess));
-			// TODO: 返信
+			pushResponse(PS2CMD_ACK);
+			pushResponse(PS2CMD_ID1);
+			pushResponse(PS2CMD_ID2);
+			break;
+		}
+		case PS2CMD_ENABLE:
+		{
+			pushResponse(PS2CMD_ACK);
+			g_Kbd.enabled = true;
+			break;
+		}
+		case PS2CMD_DISABLE:
+		case PS2CMD_DEFAULT:
+		{
+			pushResponse(PS2CMD_ACK);
+			kbd_SetDefault();
+			g_Kbd.enabled = (data == PS2CMD_DEFAULT);
+			break;
+		}
+		case PS2CMD_SET3ALLTYPEMATIC:
+		case PS2CMD_SET3ALLMAKEBREAK:
+		case PS2CMD_SET3ALLMAKE:
+		case PS2CMD_SET3ALLTYPEMATICMAKEBREAK:
+		{
+			pushResponse(PS2CMD_ACK);
 			break;
 		}
 		case PS2CMD_RESEND:
 		{
-			t_PushBuff(&g_Buff, *pLastData);
-			static uint8_t mess[2];
-			mess[0] = 1;
-			mess[1] = data;
-			putUSBUSART(mess, sizeof(mess));
+			// 最後に送り終えたバイトを再送する。送信途中のレコードのバイトなら、
+			// レコードを最初から送りなおすので、ここでは何もしない
+			if (!bRecRestart)
+				pushResponse(g_Ps2Tx.lastDt);
+			break;
+		}
+		default:
+		{
+			// 知らないコマンドには再送を要求する
+			pushResponse(PS2CMD_RESEND);
 			break;
 		}
 	}
+	notifyHostCmd(1, data, 0);
 	return;
 }
 
 // ホスト側はデータを送信したい場合、
-//		CLKをHのままCLKをLにする（OCM version 3.8.2）
-//		もしくは、 CLKをLしてCLKをLにする（OCM version 3.9.0、3.9.1）
+//		CLKをHのままDATをLにする（OCM version 3.8.2）
+//		もしくは、 CLKをLにしてDATをLにする（OCM version 3.9.0、3.9.1）
+// 動作確認の対象としているホストと注意点：
+//		SX-2 OCM-PLD 3.8.2		: 送信要求は CLK=H、DAT=L
+//		SX-2 OCM-PLD 3.9.0、3.9.1	: 送信要求は CLK=L、DAT=L。CLK=Hに戻るまでRXST_STANBYRXで待つこと
+//		DE0＋DEOCM(2017/03/26)	: DATの変更からCLKの変更まで余裕が必要（PS2_T_DATSETUP_US）
+//								  ブレークコードの１バイト目と２バイト目の間に間隔を置く必要がある
+//								  （PS2GAP_BREAK）
+//		ファームウェアを変更したときは、これらすべてで動作を確認すること。
 // 予備知識：
 //		PS/2 インターフェースは、ホスト(SX-2)とデバイス側(PS2VKBD)とは、CLK、DATの２本のラインで
 //		双方向通信を行う。同じラインに対して両社が出力を行うため、出力を行いつつ、同じラインがどの
@@ -340,39 +1574,76 @@ void tasksub_ReceiveData(const uint8_t data, bool *pbWaitLed, enum PS2CMD *pLast
 //		RXST_RXのとき、
 //			１バイト分の受信処理を行って、IDOL状態へ戻す
 //	
-// 現バージョン、対応できていない動作：
-//	（１）デバイスから１バイトの送信している最中でもホストからの送信禁止の支持をチェックしなければならないのだろうが、
-//			１バイト分を送信しきるまでチェックをしない。PS2VKBDの回路の設計が悪く、デバイスの出力がラインに範囲されるまで
-//			少し時間がかかるため、CLK=Hを出力した直後にCLK=Hかどうかをチェックしても正確に確認できないため。
+// 送信中の送信禁止：
+//	（１）デバイスから１バイトの送信している最中も、ホストからの送信禁止（CLK=L）をビットごとにチェックする。
+//			PS2VKBDの回路の設計が悪く、デバイスの出力がラインに反映されるまで少し時間がかかるため、
+//			CLK=Hを出力した直後ではなく、CLK=Hの期間の終わり（次のビットを出力する直前）でチェックする。
+//			送信禁止だったら、そのバイトの送信をやめてDAT=Hに戻す。
 //	（２）複数バイト（ブレークコード等）をホストへ送信している途中に送信禁止になった場合、
-//			最初のバイトから再送しなければならないが、それがまだできていない。
+//			レコード（スキャンコード全体）の最初のバイトから再送する。
 //
 static void taskReceivePS2()
 {
 	enum PS2_RXST { RXST_IDOL, RXST_STANBYRX, RXST_RX};
 	static enum PS2_RXST sts = RXST_IDOL;
-	static bool bWaitLed = false;
+	static enum PS2CMD waitArg = PS2CMD_NONE;	// 引数を待っているコマンド
+	static struct RINGBUFF *pTxBuff = &g_Buff;	// 送信中のレコードがあるバッファ
+	PS2_PROBE_RX_STATE(sts);
 	switch(sts)
 	{
 		case RXST_IDOL:
 		{
+			// 送信中は、ラインを見ても自分の出力が見えるだけなので何もしない
+			if (g_Ps2Tx.busy)
+				break;
+			if (g_Ps2Tx.done) {
+				g_Ps2Tx.done = false;
+				g_Ps2Tx.lastDt = g_Ps2Tx.dt;
+				// レコードの最後のバイトを送り終えるまでは、バッファから削除しない
+				if (!g_Ps2Tx.recEnd) {
+					++g_Ps2Tx.seqSent;
+				}
+				else {
+					for (uint8_t t = 0; t <= g_Ps2Tx.seqSent; ++t)
+						t_DelBtmBuff(pTxBuff);
+					// 送りなおしたバイトを重ねて数えないように、レコードを送り終えたときにまとめて数える
+					if (pTxBuff == &g_Buff)
+						g_SentCnt += g_Ps2Tx.seqSent + 1;
+					g_Ps2Tx.seqSent = 0;
+				}
+				resetWaitCnt100us();
+			}
+			if (g_Ps2Tx.aborted) {
+				g_Ps2Tx.aborted = false;
+				g_Ps2Tx.seqSent = 0;	// レコードの最初のバイトから送りなおす
+				resetWaitCnt100us();
+			}
+			if (g_bReqCalib)
+				calibrateLineSettle();
+			if (g_Ps2Tx.clkRiseDone) {
+				g_Ps2Tx.clkRiseDone = false;
+				applyLineSettle();
+			}
+			hostReq_Arm();
 			const uint8_t clk = CLK_IN();
 			const uint8_t dat = DAT_IN();
-			if (dat == IN_L) {
+			if (dat == IN_L || g_HostReq) {
+				EXT_INT0_InterruptDisable();
 				sts = RXST_STANBYRX;
-				g_Wait100us = 0;
+				g_Wait100us = hostReq_Accept();
 			}
 			else if(clk == IN_H) {
 				// 送信許可で送信データがある場合は、PS/2への送信を行う
-				uint8_t dt;
-				if (!t_PopBuff(&g_Buff, &dt))
+				// 応答があればキー入力より先に送る（キー入力のレコードの途中には割り込まない）
+				if (g_Ps2Tx.seqSent == 0)
+					pTxBuff = (t_LenBuff(&g_RespBuff) != 0) ? &g_RespBuff : &g_Buff;
+				const struct RINGENTRY *pEnt = t_PeekBuff(pTxBuff, g_Ps2Tx.seqSent);
+				if (pEnt == NULL)
 					break;
-				if (g_WaitCnt100us < g_WaitCnt100usTarget )
+				if (g_WaitCnt100us < pEnt->gap)
 					break;
-				if( sendDataToPS2(dt) ){
-					t_DelBtmBuff(&g_Buff);
-					g_WaitCnt100us = 0;
-				}
+				g_Ps2Tx.recEnd = pEnt->end;
+				sendDataToPS2(pEnt->dt);
 			}
 			break;
 		}
@@ -383,7 +1654,7 @@ static void taskReceivePS2()
 				g_Wait100us = 0;
 			}
 			else {
-				if (150 < ++g_Wait100us){	// 15ms Timeout
+				if (150 < g_Wait100us){	// 15ms Timeout
 					sts = RXST_IDOL;
 				}
 			}
@@ -391,10 +1662,10 @@ static void taskReceivePS2()
 		}
 		case RXST_RX:
 		{
-  			static enum PS2CMD lastData = PS2CMD_TESTDONE;
 			uint8_t data;
-			if (2000 < ++g_Wait100us){
+			if (2000 < g_Wait100us){	// 200ms Timeout
 				sts = RXST_IDOL;
+				break;
 			}
 			// スタートビットの終わりまで待つ
 			if( DAT_IN() == IN_H )
@@ -402,20 +1673,20 @@ static void taskReceivePS2()
 			// データビット、パリティの受信を行う。
 			//	成功したら、受信データに応じた処理を行う。
 			if (recvDataFromPS2(&data)) {
-				if (bWaitLed) {
-					bWaitLed = false;
-					t_PushBuff(&g_Buff, lastData = PS2CMD_ACK);
-					g_WaitCnt100us = 0;
-					g_WaitCnt100usTarget = 4;
-					static uint8_t mess[3];
-					mess[0] = 2;
-					mess[1] = PS2CMD_LED;
-					mess[2] = data;
-					putUSBUSART(mess, sizeof(mess));
-				} 
-				else {
-					tasksub_ReceiveData(data, &bWaitLed, &lastData);
-				}
+				PS2_PROBE_RX_DONE(data);
+				resetWaitCnt100us();	// 応答の間隔はコマンドを受信し終えたときから数える
+				// 送信途中のレコードがあれば、応答を送った後で最初から送りなおす
+				const bool bRecRestart = (g_Ps2Tx.seqSent != 0);
+				g_Ps2Tx.seqSent = 0;
+				// 引数を待っている間にコマンドを受信したら、引数はやめてコマンドとして扱う。
+				// （ホストが引数を送らずにやめてしまっても、待ち状態のままにならないようにする）
+				// RESENDは、ホストが応答を受け取りそこねただけなので、再送した後も引数を待つ。
+				if (PS2CMD_LED <= data && data != PS2CMD_RESEND)
+					waitArg = PS2CMD_NONE;
+				if (waitArg != PS2CMD_NONE && data != PS2CMD_RESEND)
+					tasksub_ReceiveArg(waitArg, data, &waitArg);
+				else
+					tasksub_ReceiveData(data, &waitArg, bRecRestart);
 			}
 			sts = RXST_IDOL;
 			break;
@@ -425,18 +1696,16 @@ static void taskReceivePS2()
 }
 
 // タイマー割込みを使用すると 40us などの待ちを待ちを使用するのに__delay_us()を使用したときに、
-// __delay_us()の精度が悪くなるので、タイマー割込みを使用しないようにしている。
+// __delay_us()の精度が悪くなるので、時間を作るためにタイマー割込みを使用しないようにしている。
+// （TMR2の割込みは送信中だけ使う。受信で__delay_us()を使うのは送信していないときだけ）
+// 時間はフリーランさせたTMR1（割込みなし）を読んで作り出す。メインループ1周の時間には依存しない。
+// ただし、TMR1が1周する（約43ms）以上メインループが止まった場合はその分の時間を数え損なう。
 static void taskTimeCount()
 {
-	static uint8_t timebase = 0;
-	// メインループ1周は約25usかかるという実測に基づく。よって4下位カウントして100usを作り出す。
-	// ソフト修正したら、周期を測定しなおす必要あり
-	if (++timebase == 4) {
-		timebase = 0;
-		if(g_WaitCnt100us < 10)	// 1ms
-			++g_WaitCnt100us;
-		++g_Wait100us;
-	}
+	updateTimeCount();
+#if defined(APP_LOOP_PROFILE)
+	loopProf_Add();
+#endif
 	return;
 }
 
@@ -455,7 +1724,16 @@ static void taskTimeCount()
 void APP_Initialize()
 {
 	ps2powsts = PS2POW_IN();
-	t_InitBuff(&g_Buff);
+	t_InitBuff(&g_Buff, g_BuffEnt, RINGBUFF_SIZE);
+	t_InitBuff(&g_RespBuff, g_RespBuffEnt, RESPBUFF_SIZE);
+	ps2tx_SetClockPeriod(PS2TX_CLKPERIOD_DEFAULT_US);
+	g_Ps2Tx.lastDt = PS2CMD_TESTDONE;	// 電源投入時の自己診断の結果を送ったことにする
+	g_Ps2Tx.prStopHold = PS2TX_PR2(g_SettleUs);
+	TMR2_SetInterruptHandler(ps2tx_Isr);
+	INT0_SetInterruptHandler(hostReq_Isr);
+#if defined(APP_LOOP_PROFILE)
+	loopProf_Init();
+#endif
 	CLK_OUT(OUT_H);
 	DAT_OUT(OUT_H);
 	return;
@@ -479,9 +1757,10 @@ void APP_Tasks()
 {
 	if (USBGetDeviceState() < CONFIGURED_STATE || USBIsDeviceSuspended() == true)
 		return;
-	taskReceivePS2();
-	taskUSB();
-	taskTimeCount();
+	APP_TASKPROF(APP_TASKPROF_RECEIVEPS2, taskReceivePS2());
+	APP_TASKPROF(APP_TASKPROF_USB, taskUSB());
+	APP_TASKPROF(APP_TASKPROF_TIMECOUNT, taskTimeCount());
+	APP_TASKPROF(APP_TASKPROF_TYPEMATIC, taskTypematic());
 	return;
 }
 
@@ -5,6 +5,12 @@
 #include <stddef.h>
 #include "usb_device_cdc.h"
 
+// メインループ1周の時間を計測し、'P'コマンドでPC側へ返す（計測用。通常は無効にしておく）
+//#define APP_LOOP_PROFILE
+
+// 各タスクの処理時間（最大、回数、累計）を計測し、'C'コマンドでPC側へ返す（計測用。通常は無効にしておく）
+//#define APP_TASK_PROFILE
+
 void APP_Initialize(void);
 void APP_Tasks(void);
 
@@ -17,4 +23,27 @@ typedef enum
 
 void APP_SYSTEM_Initialize( APP_SYSTEM_STATE state );
 
+// メインループからTMR1（1カウント=8命令サイクル）を読む。割込みがTMR1を読んでも値が化けない
+uint16_t APP_ReadTick( void );
+
+// APP_TASKPROF(id, call) は call の処理時間を TMR1 のカウント（1カウント=8命令サイクル）で計測する
+#if defined(APP_TASK_PROFILE)
+typedef enum
+{
+    APP_TASKPROF_RECEIVEPS2,
+    APP_TASKPROF_USB,
+    APP_TASKPROF_TIMECOUNT,
+    APP_TASKPROF_TYPEMATIC,
+    APP_TASKPROF_USBDEVICETASKS,
+    APP_TASKPROF_CDCTXSERVICE,
+    APP_TASKPROF_NUM
+} APP_TASKPROF_ID;
+
+void APP_TaskProf_Add( APP_TASKPROF_ID id, uint16_t beginTick );
+
+#define APP_TASKPROF(id, call)  do { const uint16_t beginTick = APP_ReadTick(); call; APP_TaskProf_Add(id, beginTick); } while(0)
+#else
+#define APP_TASKPROF(id, call)  call
+#endif
+
 #endif
@@ -50,6 +50,20 @@ please contact mla_licensing@microchip.com
 
 #ifdef USB_USE_CDC
 
+/** P R O B E S **************************************************************/
+// Measurement hooks for the host-side harness (sim/usb).  They expand to
+// nothing unless CDC_PROBE_HEADER names a header that defines them.
+//   CDC_PROBE_ENTER(fn), CDC_PROBE_LEAVE(fn) : bracket the body of fn
+//   CDC_PROBE_COPY(fn, n)                    : fn copied n bytes
+#if defined(CDC_PROBE_HEADER)
+    #include CDC_PROBE_HEADER
+#endif
+#if !defined(CDC_PROBE_ENTER)
+    #define CDC_PROBE_ENTER(fn)
+    #define CDC_PROBE_LEAVE(fn)
+    #define CDC_PROBE_COPY(fn, n)
+#endif
+
 #ifndef FIXED_ADDRESS_MEMORY
     #define IN_DATA_BUFFER_ADDRESS_TAG
     #define OUT_DATA_BUFFER_ADDRESS_TAG
@@ -90,6 +104,8 @@ uint8_t cdc_mem_type;          // _ROM, _RAM
 USB_HANDLE CDCDataOutHandle;
 USB_HANDLE CDCDataInHandle;
 
+static bool cdcRxLent;                 // cdc_data_rx is lent to the application
+
 
 CONTROL_SIGNAL_BITMAP control_signal_bitmap;
 uint32_t BaudRateGen;			// BRG value calculated from baud rate
@@ -259,6 +275,11 @@ void USBCheckCDCRequest(void)
 
 }//end USBCheckCDCRequest
 
+static void CDCRxArm(void)
+{
+    CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
+}
+
 /** U S E R  A P I ***********************************************************/
 
 /**************************************************************************
@@ -315,7 +336,8 @@ void CDCInitEP(void)
     USBEnableEndpoint(CDC_COMM_EP,USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
     USBEnableEndpoint(CDC_DATA_EP,USB_IN_ENABLED|USB_OUT_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
 
-    CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
+    cdcRxLent = false;
+    CDCRxArm();
     CDCDataInHandle = NULL;
 
     #if defined(USB_CDC_SUPPORT_DSR_REPORTING)
@@ -426,9 +448,10 @@ bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size)
     switch( (uint16_t)event )
     {
         case EVENT_TRANSFER_TERMINATED:
-            if(pdata == CDCDataOutHandle)
+            //A lent buffer is re-armed by CDCRxReleasePacket().
+            if((pdata == CDCDataOutHandle) && !cdcRxLent)
             {
-                CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
+                CDCRxArm();
             }
             if(pdata == CDCDataInHandle)
             {
@@ -484,35 +507,106 @@ bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size)
   **********************************************************************************/
 uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len)
 {
+    uint8_t rxLen;
+    volatile uint8_t *pData;
+
+    CDC_PROBE_ENTER(getsUSBUSART);
+    pData = CDCRxGetPacket(&rxLen);
+
     cdc_rx_len = 0;
 
-    if(!USBHandleBusy(CDCDataOutHandle))
+    if(pData != NULL)
     {
         /*
          * Adjust the expected number of BYTEs to equal
          * the actual number of BYTEs received.
          */
-        if(len > USBHandleGetLength(CDCDataOutHandle))
-            len = USBHandleGetLength(CDCDataOutHandle);
+        if(len > rxLen)
+            len = rxLen;
 
         /*
          * Copy data from dual-ram buffer to user's buffer
          */
         for(cdc_rx_len = 0; cdc_rx_len < len; cdc_rx_len++)
-            buffer[cdc_rx_len] = cdc_data_rx[cdc_rx_len];
+            buffer[cdc_rx_len] = pData[cdc_rx_len];
+        CDC_PROBE_COPY(getsUSBUSART, cdc_rx_len);
 
         /*
          * Prepare dual-ram buffer for next OUT transaction
          */
-
-        CDCDataOutHandle = USBRxOnePacket(CDC_DATA_EP,(uint8_t*)&cdc_data_rx,sizeof(cdc_data_rx));
+        CDCRxReleasePacket();
 
     }//end if
 
+    CDC_PROBE_LEAVE(getsUSBUSART);
     return cdc_rx_len;
 
 }//end getsUSBUSART
 
+/**********************************************************************************
+  Function:
+        volatile uint8_t* CDCRxGetPacket(uint8_t *length)
+
+  Summary:
+    Lends the CDC bulk OUT endpoint buffer holding the oldest received
+    packet to the application, without copying it.
+
+  Description:
+    CDCRxGetPacket returns a pointer to the endpoint buffer that holds the
+    oldest received packet, or NULL if none has arrived.  The buffer stays
+    owned by the application and is not re-armed until CDCRxReleasePacket()
+    is called, so it must be released as soon as the packet is parsed.  The
+    host is NAKed until the release.  (There is a single OUT buffer: the
+    PIC18F14K50 has no USB RAM left for a second 64-byte ping-pong buffer.)
+
+    Typical Usage:
+    <code>
+        uint8_t numBytes;
+        volatile uint8_t *p = CDCRxGetPacket(&numBytes);
+        if(p != NULL)
+        {
+            //parse numBytes bytes at p here
+            CDCRxReleasePacket();
+        }
+    </code>
+  Conditions:
+    getsUSBUSART() must not be called while a packet is lent.
+  Input:
+    length -  Receives the packet length, which may be 0.
+  Output:
+    Pointer to the packet, or NULL if no packet is available or one is
+    already lent.
+
+  **********************************************************************************/
+volatile uint8_t* CDCRxGetPacket(uint8_t *length)
+{
+    if(cdcRxLent || USBHandleBusy(CDCDataOutHandle))
+    {
+        return NULL;
+    }
+    cdcRxLent = true;
+    *length = (uint8_t)USBHandleGetLength(CDCDataOutHandle);
+    return cdc_data_rx;
+}
+
+/**********************************************************************************
+  Function:
+        void CDCRxReleasePacket(void)
+
+  Summary:
+    Returns the buffer lent by CDCRxGetPacket() to the endpoint and re-arms it.
+
+  **********************************************************************************/
+void CDCRxReleasePacket(void)
+{
+    if(!cdcRxLent)
+    {
+        return;
+    }
+    cdcRxLent = false;
+    CDCRxArm();
+}
+
 /******************************************************************************
   Function:
 	void putUSBUSART(char *data, uint8_t length)
@@ -578,12 +672,14 @@ void putUSBUSART(uint8_t *data, uint8_t  length)
      * multi-tasking and a blocking code is not acceptable.
      * Use a state machine instead.
      */
+    CDC_PROBE_ENTER(putUSBUSART);
     USBMaskInterrupts();
     if(cdc_trf_state == CDC_TX_READY)
     {
         mUSBUSARTTxRam((uint8_t*)data, length);     // See cdc.h
     }
     USBUnmaskInterrupts();
+    CDC_PROBE_LEAVE(putUSBUSART);
 }//end putUSBUSART
 
 /******************************************************************************
@@ -838,6 +934,7 @@ void CDCTxService(void)
     uint8_t byte_to_send;
     uint8_t i;
 
+    CDC_PROBE_ENTER(CDCTxService);
     USBMaskInterrupts();
 
     CDCNotificationHandler();
@@ -845,6 +942,7 @@ void CDCTxService(void)
     if(USBHandleBusy(CDCDataInHandle))
     {
         USBUnmaskInterrupts();
+        CDC_PROBE_LEAVE(CDCTxService);
         return;
     }
 
@@ -862,6 +960,7 @@ void CDCTxService(void)
     if(cdc_trf_state == CDC_TX_READY)
     {
         USBUnmaskInterrupts();
+        CDC_PROBE_LEAVE(CDCTxService);
         return;
     }
 
@@ -912,6 +1011,7 @@ void CDCTxService(void)
                 i--;
             }
         }
+        CDC_PROBE_COPY(CDCTxService, byte_to_send);
 
         /*
          * Lastly, determine if a zero length packet state is necessary.
@@ -929,6 +1029,7 @@ void CDCTxService(void)
     }//end if(cdc_tx_sate == CDC_TX_BUSY)
 
     USBUnmaskInterrupts();
+    CDC_PROBE_LEAVE(CDCTxService);
 }//end CDCTxService
 
 #endif //USB_USE_CDC
@@ -652,6 +652,29 @@ bool USBCDCEventHandler(USB_EVENT event, void *pdata, uint16_t size);
   **********************************************************************************/
 uint8_t getsUSBUSART(uint8_t *buffer, uint8_t len);
 
+/**********************************************************************************
+  Function:
+        volatile uint8_t* CDCRxGetPacket(uint8_t *length)
+
+  Summary:
+    Lends the CDC bulk OUT endpoint buffer holding the oldest received
+    packet to the application without copying it.  Returns NULL if no
+    packet is available.  The buffer is not re-armed until
+    CDCRxReleasePacket() is called.
+
+  **********************************************************************************/
+volatile uint8_t* CDCRxGetPacket(uint8_t *length);
+
+/**********************************************************************************
+  Function:
+        void CDCRxReleasePacket(void)
+
+  Summary:
+    Returns the buffer lent by CDCRxGetPacket() to the endpoint and re-arms it.
+
+  **********************************************************************************/
+void CDCRxReleasePacket(void);
+
 /******************************************************************************
   Function:
 	void putUSBUSART(char *data, uint8_t length)
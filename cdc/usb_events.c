@@ -18,7 +18,7 @@ please contact mla_licensing@microchip.com
 *******************************************************************************/
 
 /** INCLUDES *******************************************************/
-#include "..\app.h"
+#include "../app.h"
 
 #include "usb.h"
 #include "usb_device.h"
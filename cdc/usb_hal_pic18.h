@@ -366,8 +366,10 @@ typedef union _POINTER
 // *****************************************************************************
 // *****************************************************************************
 
+#if !defined(ConvertToPhysicalAddress)
 #define ConvertToPhysicalAddress(a) ((uint16_t)(a))
 #define ConvertToVirtualAddress(a)  ((void *)(a))
+#endif
 
 
 //------------------------------------------------------------------------------
@@ -64,17 +64,19 @@ void main(void)
     APP_SYSTEM_Initialize(APP_SYSTEM_STATE_USB_START);
     USBDeviceInit();
 #if defined(USB_POLLING)
-	//INTERRUPT_GlobalInterruptEnable();	// USB_INTERRUPTのときはUSBDeviceInit()内で行われる。
+	// USB_INTERRUPTのときはUSBDeviceInit()内で行われる。PS/2の送信にTMR2の割込みを使用する。
+	INTERRUPT_GlobalInterruptEnable();
+	INTERRUPT_PeripheralInterruptEnable();
 #endif
     USBDeviceAttach();
 	APP_Initialize();
     while(1)
     {
 #if defined(USB_POLLING)
-		USBDeviceTasks();
+		APP_TASKPROF(APP_TASKPROF_USBDEVICETASKS, USBDeviceTasks());
 #endif
         APP_Tasks();
-	    CDCTxService();
+	    APP_TASKPROF(APP_TASKPROF_CDCTXSERVICE, CDCTxService());
     }
 }
 /**
@@ -0,0 +1,97 @@
+/**
+  EXT_INT Generated Driver File
+
+  @Company:
+    Microchip Technology Inc.
+
+  @File Name:
+    ext_int.c
+
+  @Summary:
+    This is the generated driver implementation file for the EXT_INT driver using PIC10 / PIC12 / PIC16 / PIC18 MCUs
+
+  @Description:
+    This source file provides implementations for driver APIs for EXT_INT.
+    Generation Information :
+        Product Revision  :  PIC10 / PIC12 / PIC16 / PIC18 MCUs - 1.81.7
+        Device            :  PIC18F14K50
+        Driver Version    :  2.03
+    The generated drivers are tested against the following:
+        Compiler          :  XC8 2.31 and above
+        MPLAB 	          :  MPLAB X 5.45
+*/
+
+/*
+    (c) 2018 Microchip Technology Inc. and its subsidiaries. 
+    
+    Subject to your compliance with these terms, you may use Microchip software and any 
+    derivatives exclusively with Microchip products. It is your responsibility to comply with third party 
+    license terms applicable to your use of third party software (including open source software) that 
+    may accompany Microchip software.
+    
+    THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER 
+    EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY 
+    IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS 
+    FOR A PARTICULAR PURPOSE.
+    
+    IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE, 
+    INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND 
+    WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP 
+    HAS BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO 
+    THE FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL 
+    CLAIMS IN ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT 
+    OF FEES, IF ANY, THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS 
+    SOFTWARE.
+*/
+
+/**
+   Section: Includes
+ */
+#include <xc.h>
+#include "ext_int.h"
+
+void (*INT0_InterruptHandler)(void);
+
+void INT0_ISR(void)
+{
+    EXT_INT0_InterruptFlagClear();
+
+    // Callback function gets called everytime this ISR executes
+    INT0_CallBack();    
+}
+
+
+void INT0_CallBack(void)
+{
+    // Add your custom callback code here
+    if(INT0_InterruptHandler)
+    {
+        INT0_InterruptHandler();
+    }
+}
+
+void INT0_SetInterruptHandler(void (* InterruptHandler)(void)){
+    INT0_InterruptHandler = InterruptHandler;
+}
+
+void INT0_DefaultInterruptHandler(void){
+    // add your INT0 interrupt custom code
+    // or set custom function using INT0_SetInterruptHandler()
+}
+
+void EXT_INT_Initialize(void)
+{
+    
+    /*******
+     * INT0
+     * Clear the interrupt flag
+     * Set the external interrupt edge detect
+     * Leave the interrupt disabled (enabled by the application)
+     ********/
+    EXT_INT0_InterruptFlagClear();   
+    EXT_INT0_fallingEdgeSet();    
+    // Set Default Interrupt Handler
+    INT0_SetInterruptHandler(INT0_DefaultInterruptHandler);
+    EXT_INT0_InterruptDisable();      
+
+}
@@ -0,0 +1,295 @@
+/**
+  EXT_INT Generated Driver API Header File
+
+  @Company:
+    Microchip Technology Inc.
+
+  @File Name:
+    ext_int.h
+
+  @Summary:
+    This is the generated header file for the EXT_INT driver using PIC10 / PIC12 / PIC16 / PIC18 MCUs
+
+  @Description:
+    This header file provides APIs for driver for EXT_INT.
+    Generation Information :
+        Product Revision  :  PIC10 / PIC12 / PIC16 / PIC18 MCUs - 1.81.7
+        Device            :  PIC18F14K50
+        Driver Version    :  2.03
+    The generated drivers are tested against the following:
+        Compiler          :  XC8 2.31 and above
+        MPLAB 	          :  MPLAB X 5.45
+*/
+
+/*
+    (c) 2018 Microchip Technology Inc. and its subsidiaries. 
+    
+    Subject to your compliance with these terms, you may use Microchip software and any 
+    derivatives exclusively with Microchip products. It is your responsibility to comply with third party 
+    license terms applicable to your use of third party software (including open source software) that 
+    may accompany Microchip software.
+    
+    THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER 
+    EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY 
+    IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS 
+    FOR A PARTICULAR PURPOSE.
+    
+    IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE, 
+    INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND 
+    WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP 
+    HAS BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO 
+    THE FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL 
+    CLAIMS IN ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT 
+    OF FEES, IF ANY, THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS 
+    SOFTWARE.
+*/
+
+#ifndef EXT_INT_H
+#define EXT_INT_H
+
+/**
+    Section: Includes
+*/
+#include <xc.h>
+
+// Provide C++ Compatibility
+#ifdef __cplusplus  
+
+extern "C" {
+
+#endif
+
+/**
+    Section: Macros
+*/
+
+/**
+  @Summary
+    Clears the interrupt flag for INT0
+
+  @Description
+    This routine clears the interrupt flag for the external interrupt, INT0 (RC0).
+ 
+  @Preconditions
+    None.
+
+  @Returns
+    None.
+
+  @Param
+    None.
+
+  @Example
+    <code>
+    void INT0_ISR(void)
+    {
+        // User Area Begin->code
+
+        // User Area End
+
+        EXT_INT0_InterruptFlagClear();
+    }
+    </code>
+*/
+#define EXT_INT0_InterruptFlagClear()       (INTCONbits.INT0IF = 0)
+
+/**
+  @Summary
+    Clears the interrupt enable for INT0
+
+  @Description
+    This routine clears the interrupt enable for the external interrupt, INT0 (RC0).
+    After calling this routine, external interrupts on this pin will not be serviced by the 
+    interrupt handler, INT0_ISR.
+ 
+  @Preconditions
+    None.
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+#define EXT_INT0_InterruptDisable()     (INTCONbits.INT0IE = 0)
+
+/**
+  @Summary
+    Sets the interrupt enable for INT0
+
+  @Description
+    This routine sets the interrupt enable for the external interrupt, INT0 (RC0).
+    After calling this routine, external interrupts on this pin will be serviced by the 
+    interrupt handler, INT0_ISR.
+ 
+  @Preconditions
+    None.
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+#define EXT_INT0_InterruptEnable()       (INTCONbits.INT0IE = 1)
+
+/**
+  @Summary
+    Returns whether the interrupt for INT0 is enabled
+ 
+  @Preconditions
+    None.
+
+  @Returns
+    1 if enabled, 0 otherwise.
+
+  @Param
+    None.
+*/
+#define EXT_INT0_InterruptIsEnabled()    (INTCONbits.INT0IE)
+
+/**
+  @Summary
+    Sets the edge detect of the external interrupt to negative edge.
+
+  @Description
+    This routine set the edge detect of the extern interrupt to negative 
+    edge.  After this routine is called the interrupt flag will be set when the 
+    external interrupt pins level transitions from a high to low level.
+ 
+  @Preconditions
+    None.
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+#define EXT_INT0_fallingEdgeSet()          (INTCON2bits.INTEDG0 = 0)
+
+/**
+    Section: External Interrupt Initializers
+ */
+/**
+  @Summary
+    Initializes the external interrupt on INT0 (RC0).
+
+  @Description
+    This routine initializes the EXT_INT driver to detect the falling edge of
+    the PS/2 DAT line. The interrupt is left disabled; the application enables
+    it while it is waiting for a host request.
+
+  @Preconditions
+    None.
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+void EXT_INT_Initialize(void);
+
+/**
+   Section: External Interrupt Handlers
+ */
+/**
+  @Summary
+    Interrupt Service Routine for EXT_INT - INT0 pin
+
+  @Description
+    This ISR will execute whenever the signal on the INT0 pin will transition to the preconfigured state.
+    
+  @Preconditions
+    EXT_INT intializer called
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+void INT0_ISR(void);
+
+/**
+  @Summary
+    Callback function for EXT_INT - INT0
+
+  @Description
+    Allows for a specific callback function to be called in the INT0 ISR.
+    It also allows for a non-specific interrupt handler to be called at run-time.
+    
+  @Preconditions
+    EXT_INT intializer called
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+void INT0_CallBack(void);
+
+/**
+  @Summary
+    Dynamic Interrupt Handler for INT0 pin
+
+  @Description
+    This function sets the function to be called during the ISR
+
+  @Preconditions
+    EXT_INT intializer called
+
+  @Returns
+    None.
+
+  @Param
+    Address of function to be set
+*/
+void INT0_SetInterruptHandler(void (* InterruptHandler)(void));
+
+/**
+  @Summary
+    Dynamic Interrupt Handler for INT0 pin
+
+  @Description
+    This is a function pointer to the function that will be called during the ISR
+
+  @Preconditions
+    EXT_INT intializer called
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+extern void (*INT0_InterruptHandler)(void);
+
+/**
+  @Summary
+    Default Interrupt Handler for INT0 pin
+
+  @Description
+    This is a predefined interrupt handler to be used together with the INT0_SetInterruptHandler() method.
+    This handler is called every time the INT0 ISR is executed. 
+    
+  @Preconditions
+    EXT_INT intializer called
+
+  @Returns
+    None.
+
+  @Param
+    None.
+*/
+void INT0_DefaultInterruptHandler(void);
+
+// Provide C++ Compatibility
+#ifdef __cplusplus  
+
+}
+
+#endif
+#endif
@@ -49,8 +49,12 @@
 
 void SYSTEM_Initialize(void)
 {
+    INTERRUPT_Initialize();
     PIN_MANAGER_Initialize();
     OSCILLATOR_Initialize();
+    TMR1_Initialize();
+    TMR2_Initialize();
+    EXT_INT_Initialize();
 }
 
 void OSCILLATOR_Initialize(void)
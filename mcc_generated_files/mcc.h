@@ -49,6 +49,10 @@
 #include <xc.h>
 #include "device_config.h"
 #include "pin_manager.h"
+#include "interrupt_manager.h"
+#include "tmr1.h"
+#include "tmr2.h"
+#include "ext_int.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <conio.h>
@@ -0,0 +1,133 @@
+/**
+  TMR1 Generated Driver API Header File
+
+  @Company
+    Microchip Technology Inc.
+
+  @File Name
+    tmr1.h
+
+  @Summary
+    This is the generated header file for the TMR1 driver using PIC10 / PIC12 / PIC16 / PIC18 MCUs
+
+  @Description
+    This header file provides APIs for driver for TMR1.
+    Generation Information :
+        Product Revision  :  PIC10 / PIC12 / PIC16 / PIC18 MCUs - 1.81.7
+        Device            :  PIC18F14K50
+        Driver Version    :  2.11
+    The generated drivers are tested against the following:
+        Compiler          :  XC8 2.31 and above
+        MPLAB 	          :  MPLAB X 5.45
+*/
+
+/*
+    (c) 2018 Microchip Technology Inc. and its subsidiaries. 
+    
+    Subject to your compliance with these terms, you may use Microchip software and any 
+    derivatives exclusively with Microchip products. It is your responsibility to comply with third party 
+    license terms applicable to your use of third party software (including open source software) that 
+    may accompany Microchip software.
+    
+    THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER 
+    EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY 
+    IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS 
+    FOR A PARTICULAR PURPOSE.
+    
+    IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE, 
+    INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND 
+    WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP 
+    HAS BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO 
+    THE FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL 
+    CLAIMS IN ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT 
+    OF FEES, IF ANY, THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS 
+    SOFTWARE.
+*/
+
+#ifndef TMR1_H
+#define TMR1_H
+
+/**
+  Section: Included Files
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus  // Provide C++ Compatibility
+
+    extern "C" {
+
+#endif
+
+/**
+  Section: Macro Declarations
+*/
+
+// Fosc/4 (12MHz) を 1:8 で分周して 1.5MHz で計数する。
+#define TMR1_TICKS_PER_100US    150
+
+/**
+  Section: TMR1 APIs
+*/
+
+/**
+  @Summary
+    Initializes the TMR1
+
+  @Description
+    This routine initializes the TMR1.
+    This routine must be called before any other TMR1 routine is called.
+    TMR1 runs free with a 1:8 prescaler and no interrupt.
+
+  @Preconditions
+    None
+
+  @Param
+    None
+
+  @Returns
+    None
+
+  @Example
+    <code>
+    TMR1_Initialize();
+    </code>
+*/
+void TMR1_Initialize(void);
+
+/**
+  @Summary
+    Reads the TMR1 register.
+
+  @Description
+    This function reads the TMR1 register value and return it.
+
+  @Preconditions
+    Initialize  the TMR1 before calling this function.
+
+  @Param
+    None
+
+  @Returns
+    This function returns the current value of TMR1 register
+
+  @Example
+    <code>
+    uint16_t start = TMR1_ReadTimer();
+    ...
+    uint16_t elapsed = TMR1_ReadTimer() - start;
+    </code>
+*/
+uint16_t TMR1_ReadTimer(void);
+
+#ifdef __cplusplus  // Provide C++ Compatibility
+
+    }
+
+#endif
+
+#endif // TMR1_H
+/**
+ End of File
+*/
@@ -0,0 +1,97 @@
+#ifndef PS2_PORT_H
+#define PS2_PORT_H
+
+#include <stdint.h>
+
+// PS/2 ライン(CLK、DAT)とSX-2側電源検出ピンの入出力、および待ち時間をまとめたもの。
+// app.c はこのヘッダを経由してのみピンを操作する。
+
+// PS/2 ラインのタイミング（単位 us）。
+// 送信の実際のタイミングは、これをもとに実行時に決まる（app.c の g_Ps2Tx.prClkL、prClkH、prStopHold）。
+// クロックエッジの余裕は、sim/ の ps2sim --vcd で記録した波形で確かめること。
+#define PS2_T_DATSETUP_US	5	// DAT変更からCLK=Lまで
+#define PS2_T_CLKL_US		35	// CLK=Lの期間
+#define PS2_T_CLKH_US		35	// CLK=Hの期間
+#define PS2_T_ACK_US		20	// 応答ビットのCLK=L、CLK=Hの期間
+#define PS2_T_STOPHOLD_US	20	// ラインが落ち着くまでの待ち（オープンコレクタの立ち上がり待ち。実測できなかったときの値）
+
+// PS2_PORT_HEADER が定義されている場合は、そのヘッダで以下をすべて定義すること。
+// ホストPC上でシミュレーションを行う際に、ピン入出力と __delay_us() を仮想的なPS/2ホスト
+// モデルに差し替えるために使用する。
+//		OUT_H、OUT_L、IN_H、IN_L
+//		PS2POW_IN()、CLK_IN()、DAT_IN()、CLK_OUT()、DAT_OUT()
+//		PS2_DELAY_US()
+// app.c が外部に依存しているのは、このほかに次のものである。sim/ ではこれらを mcc_generated_files の
+// 本物と、レジスタを置き換えた inc/xc.h、偽のCDC（cdc_fake.c）で動かしている。
+//		CDC		: CDCRxGetPacket()、CDCRxReleasePacket()、putUSBUSART()、USBUSARTIsTxTrfReady()、
+//				  USBGetDeviceState()、USBIsDeviceSuspended()
+//		TMR1	: TMR1_ReadTimer()
+//		TMR2	: TMR2_LoadPeriodRegister()、TMR2_WriteTimer()、TMR2_StartTimer()、TMR2_StopTimer()、
+//				  TMR2_SetInterruptHandler()、PR2
+//		INT0	: EXT_INT0_InterruptEnable()、EXT_INT0_InterruptDisable()、EXT_INT0_InterruptFlagClear()、
+//				  EXT_INT0_InterruptIsEnabled()（INTCONbits）、INT0_SetInterruptHandler()
+#if defined(PS2_PORT_HEADER)
+#include PS2_PORT_HEADER
+#else
+
+#include <xc.h>
+#include "mcc_generated_files/device_config.h"
+
+// 出力はトランジスタで反転される（1を出力するとラインがLになる）
+static const int OUT_H = 0;
+static const int OUT_L = 1;
+static const int IN_H = 1;
+static const int IN_L = 0;
+
+// 各ピンの入出力設定は、PIN_MANAGER_Initialize()に記述されています。
+static inline uint8_t PS2POW_IN()
+{
+	return PORTCbits.RC4;
+}
+
+static inline uint8_t CLK_IN()
+{
+	return PORTCbits.RC1;
+}
+
+static inline uint8_t DAT_IN()
+{
+	return PORTCbits.RC0;
+}
+
+static inline void CLK_OUT(int t)
+{
+	LATCbits.LC3 = (uint8_t)t;
+	return;
+}
+
+static inline void DAT_OUT(int t)
+{
+	LATCbits.LC2 = (uint8_t)t;
+	return;
+}
+
+// __delay_us() の引数は定数であること
+#define PS2_DELAY_US(us)	__delay_us(us)
+
+#endif
+
+// 計測用のフック。PS2_PORT_HEADER 側で定義しなければ何もしない。
+//	PS2_PROBE_USB_RX(p, n)	: USBから n バイトのパケット p を受信した
+//	PS2_PROBE_TX_DONE(dt)	: dt の終了ビットまでを送信し終えた（TMR2の割込みの中から呼ぶ）
+//	PS2_PROBE_RX_DONE(dt)	: ホストから dt を受信し、応答ビットを返した
+//	PS2_PROBE_RX_STATE(st)	: taskReceivePS2() を呼んだ。st は受信の状態（RXST_*）
+#if !defined(PS2_PROBE_USB_RX)
+#define PS2_PROBE_USB_RX(p, n)
+#endif
+#if !defined(PS2_PROBE_TX_DONE)
+#define PS2_PROBE_TX_DONE(dt)
+#endif
+#if !defined(PS2_PROBE_RX_DONE)
+#define PS2_PROBE_RX_DONE(dt)
+#endif
+#if !defined(PS2_PROBE_RX_STATE)
+#define PS2_PROBE_RX_STATE(st)
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+/*********************************************************************
+* USB CDC の偽物と、その先のPC（pc.h）
+*/
+#include <xc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usb.h"
+#include "usb_device_cdc.h"
+#include "pc.h"
+#include "sim.h"
+
+// メインループから呼ばれる処理にかかる時間の概算（実機の 'C' コマンドの値を目安にした）
+#define USBDEVICETASKS_CYC	SIM_US(8)
+#define CDCTXSERVICE_CYC	SIM_US(2)
+#define COPY_CYC_PER_BYTE	6
+#define OUT_TURNAROUND		SIM_US(100)
+#define USB_FRAME			SIM_MS(1)
+
+#define OUT_QUEUE_MAX		4096
+
+USB_VOLATILE USB_DEVICE_STATE USBDeviceState;
+uint8_t cdc_trf_state;
+
+static struct PC_MSG s_OutQueue[OUT_QUEUE_MAX];
+static int s_OutHead, s_OutTail;			// s_OutQueue のリング（PC側の送信待ち）
+static simtime_t s_OutReadyAt;			// OUTのエンドポイントが次のパケットを受け取れる時刻
+static bool s_OutLent;
+static uint8_t s_OutBuff[CDC_DATA_OUT_EP_SIZE];	// エンドポイントのバッファ
+static struct PC_MSG *s_OutLog;			// pc_Send() で送ったパケットの記録
+static int s_OutLogNum, s_OutLogCap;
+
+static uint8_t s_InMsg[CDC_DATA_IN_EP_SIZE];	// putUSBUSART() で渡されたメッセージ
+static uint8_t s_InLen;
+static simtime_t s_InDeliverAt;			// INの転送中なら、PCに届く時刻
+static struct PC_MSG *s_InLog;			// PCに届いたメッセージの記録
+static int s_InNum, s_InCap;
+static uint32_t s_InLost;
+
+void pc_Reset(void)
+{
+	s_OutHead = s_OutTail = 0;
+	s_OutLogNum = 0;
+	s_OutReadyAt = 0;
+	s_OutLent = false;
+	s_InLen = 0;
+	s_InDeliverAt = SIM_NEVER;
+	s_InNum = 0;
+	s_InLost = 0;
+	cdc_trf_state = CDC_TX_READY;
+	USBDeviceState = DETACHED_STATE;
+	return;
+}
+
+void pc_Send(const uint8_t *p, const uint8_t len)
+{
+	const int next = (s_OutTail + 1) % OUT_QUEUE_MAX;
+	if (next == s_OutHead || PC_MSG_MAX < len) {
+		fprintf(stderr, "pc: OUT queue overflow\n");
+		abort();
+	}
+	struct PC_MSG *m = &s_OutQueue[s_OutTail];
+	m->t = g_SimNow;
+	m->len = len;
+	memcpy(m->dt, p, len);
+	s_OutTail = next;
+	if (s_OutLogNum == s_OutLogCap) {
+		s_OutLogCap = (s_OutLogCap == 0) ? 4096 : s_OutLogCap * 2;
+		s_OutLog = realloc(s_OutLog, sizeof(*s_OutLog) * (size_t)s_OutLogCap);
+		if (s_OutLog == NULL)
+			abort();
+	}
+	s_OutLog[s_OutLogNum++] = *m;
+	return;
+}
+
+int pc_OutPending(void)
+{
+	return (s_OutTail - s_OutHead + OUT_QUEUE_MAX) % OUT_QUEUE_MAX;
+}
+
+int pc_OutNum(void)
+{
+	return s_OutLogNum;
+}
+
+const struct PC_MSG *pc_Out(const int idx)
+{
+	return &s_OutLog[idx];
+}
+
+int pc_InNum(void)
+{
+	return s_InNum;
+}
+
+const struct PC_MSG *pc_In(const int idx)
+{
+	return &s_InLog[idx];
+}
+
+uint32_t pc_InLost(void)
+{
+	return s_InLost;
+}
+
+/*********************************************************************
+* ファームウェアから呼ばれるもの
+*/
+void USBDeviceInit(void)
+{
+	USBDeviceState = DETACHED_STATE;
+	UCONbits.SUSPND = 0;
+	return;
+}
+
+// USB_POLLING では USBDeviceAttach() は空のマクロで、USBDeviceTasks() がつなぐ
+void USBDeviceTasks(void)
+{
+	// 列挙は省略して、すぐに使える状態にする
+	if (USBDeviceState == DETACHED_STATE)
+		USBDeviceState = CONFIGURED_STATE;
+	mcu_Advance(USBDEVICETASKS_CYC);
+	return;
+}
+
+volatile uint8_t *CDCRxGetPacket(uint8_t *length)
+{
+	*length = 0;
+	if (s_OutLent || s_OutHead == s_OutTail)
+		return NULL;
+	const struct PC_MSG *m = &s_OutQueue[s_OutHead];
+	if (g_SimNow < m->t || g_SimNow < s_OutReadyAt)
+		return NULL;
+	memcpy(s_OutBuff, m->dt, m->len);
+	*length = m->len;
+	s_OutLent = true;
+	return s_OutBuff;
+}
+
+void CDCRxReleasePacket(void)
+{
+	if (!s_OutLent)
+		return;
+	s_OutLent = false;
+	s_OutHead = (s_OutHead + 1) % OUT_QUEUE_MAX;
+	s_OutReadyAt = g_SimNow + OUT_TURNAROUND;
+	return;
+}
+
+void putUSBUSART(uint8_t *data, const uint8_t length)
+{
+	// 本物と同じく、前のメッセージを送り終えていなければ何もしない
+	if (cdc_trf_state != CDC_TX_READY) {
+		++s_InLost;
+		return;
+	}
+	if (CDC_DATA_IN_EP_SIZE < length) {
+		fprintf(stderr, "cdc: putUSBUSART length %u\n", length);
+		abort();
+	}
+	memcpy(s_InMsg, data, length);
+	s_InLen = length;
+	cdc_trf_state = CDC_TX_BUSY;
+	return;
+}
+
+void CDCTxService(void)
+{
+	mcu_Advance(CDCTXSERVICE_CYC);
+	if (s_InDeliverAt != SIM_NEVER && s_InDeliverAt <= g_SimNow) {
+		if (s_InNum == s_InCap) {
+			s_InCap = (s_InCap == 0) ? 4096 : s_InCap * 2;
+			s_InLog = realloc(s_InLog, sizeof(*s_InLog) * (size_t)s_InCap);
+			if (s_InLog == NULL)
+				abort();
+		}
+		struct PC_MSG *m = &s_InLog[s_InNum++];
+		m->t = s_InDeliverAt;
+		m->len = s_InLen;
+		memcpy(m->dt, s_InMsg, s_InLen);
+		s_InDeliverAt = SIM_NEVER;
+		cdc_trf_state = CDC_TX_READY;
+	}
+	if (cdc_trf_state == CDC_TX_BUSY && s_InDeliverAt == SIM_NEVER) {
+		// エンドポイントのバッファへコピーして、次のフレームで送る
+		mcu_Advance((simtime_t)s_InLen * COPY_CYC_PER_BYTE);
+		s_InDeliverAt = (g_SimNow / USB_FRAME + 1) * USB_FRAME;
+		cdc_trf_state = CDC_TX_COMPLETING;
+	}
+	sim_LoopEnd();
+	return;
+}
@@ -0,0 +1,367 @@
+/*********************************************************************
+* PS/2の受信（taskReceivePS2()、recvDataFromPS2()、tasksub_ReceiveData()）のファジング
+*	入力のバイト列を、ホストのラインの操作、ホストのコマンド、PCからのパケットの並びとして読み、
+*	ファームウェアを動かしながら次を確かめる。守られていなければ abort() する。
+*		・受信の状態が FUZZ_IDLE_MAX より長く RXST_IDOL に戻らないことはない
+*		・送信バッファ（g_Buff、g_RespBuff）の長さが容量を超えない
+*		・入力を実行し終えたら、ホストが何もしない時間を FUZZ_IDLE_MAX だけ置いて RXST_IDOL に戻ることを確かめる。
+*		  その後ホストから F5 を送って送信を止め、送信バッファが空になった後の
+*		  g_Ps2Tx.lastDt が最後に送り終えたバイトと同じで、FE（RESEND）を送るとそれが返ってくる
+*		・引数を取るコマンド（ED、F0、F3）とその引数を受け取ったら、最初の応答は FA（ACK）。
+*		  間に FE（RESEND）を受け取っても、引数を待ったまま
+*
+*	入力の形式。１バイト目はホストモデル（host.h の g_HostModels）の番号、その後は次の操作の並び
+*		00-1F nn	: ホストが CLK をビット0、DAT をビット1 のレベルにして (nn+1) << (ビット2-4) us 保つ。
+*					  ホストモデルの出力を上書きするので、フレームの途中にも割り込む。続けると、ラインを
+*					  離さずに次のレベルにする。ほかの操作の前と、入力の終わりでは両方を離す
+*		20-5F nn	: ホストが nn を送る（(ビット0-5) × 100us 後）
+*		60-7F nn	: ホストが ED（LED）と nn を続けて送る（(ビット0-4) × 100us 後）
+*		80-9F		: ホストが FE（RESEND）を (ビット0-4) + 1 回続けて送る
+*		A0-BF ...	: PCが 'S' と、続く (ビット0-2) + 1 バイトのパケットを送る
+*		C0-FF ...	: PCが続く (ビット0-3) + 1 バイトをそのままパケットとして送る
+*
+*	make fuzz で clang の libFuzzer を使ってビルドする（LLVMFuzzerTestOneInput()）。
+*	gcc でビルドしたもの（make ps2fuzz）は
+*		ps2fuzz [-n 回数] [-s 種] [ファイル...]
+*	で、ファイルを入力として、ファイルがなければ乱数で作った入力を 回数 だけ実行する。
+*	失敗した入力は fuzz-crash.bin に書き出す。
+*	fuzz-corpus には、ラインを長く保つ、LED の後にコマンドを送る、RESEND を続ける、LED と引数の間に
+*	RESEND を挟むなどの入力を置いてある。
+*/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcu.h"
+#include "sim.h"
+#include "host.h"
+#include "pc.h"
+#include "fuzz.h"
+
+// STANBYRX（15ms）とRX（200ms）のタイムアウトに、1バイトの受信とメインループの遅れの分を足す
+#define FUZZ_IDLE_MAX		SIM_MS(250)
+#define FUZZ_INPUT_MAX		4096
+#define FUZZ_HOST_TX_MAX	200		// 1つの入力でホストが送るバイト数（host.c の送信待ちの列に入る数）
+#define FUZZ_DRAIN_MAX		SIM_MS(5000)	// 入力を実行し終えてから、ホストとPCの送信が終わるまで
+#define FUZZ_QUIET_MAX		SIM_MS(1000)	// F5 を送ってから、送信バッファが空になるまで
+#define FUZZ_RESEND_MAX		SIM_MS(50)		// FE を送ってから、応答を受け取るまで
+
+static const uint8_t *s_Input;
+static size_t s_InputLen;
+static simtime_t s_IdleAt;		// 最後に受信の状態が RXST_IDOL だった時刻
+static uint8_t s_LastTx;		// 最後に送り終えたバイト
+static int s_HostTxNum;
+static uint8_t s_WaitArg;		// デバイスが引数を待っているコマンド（0:待っていない）
+static bool s_bAckCheck;		// 受け取ったバイトの処理が終わったら、最初の応答が FA か調べる
+static uint8_t s_AckRx;			// 調べるバイト
+static uint8_t s_AckTop;		// そのバイトを受け取ったときの fuzz_RespTop()
+
+static void fail(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+static void fail(const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "fuzz: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, " (at %.1f us)\n", (double)g_SimNow / SIM_US(1));
+	va_end(ap);
+#if !defined(FUZZ_LIBFUZZER)
+	FILE *fp = fopen("fuzz-crash.bin", "wb");
+	if (fp != NULL) {
+		fwrite(s_Input, 1, s_InputLen, fp);
+		fclose(fp);
+	}
+#endif
+	abort();
+}
+
+static void checkIdle(void)
+{
+	if (FUZZ_IDLE_MAX < g_SimNow - s_IdleAt)
+		fail("receive state stuck for %.1f ms", (double)(g_SimNow - s_IdleAt) / SIM_MS(1));
+	return;
+}
+
+// 前の onRxDone() のバイトへの応答を調べる（taskReceivePS2() の次の呼び出しでは処理が終わっている）
+static void checkAck(void)
+{
+	if (!s_bAckCheck)
+		return;
+	s_bAckCheck = false;
+	// 応答バッファがいっぱいで入らなかったときは調べない
+	if (fuzz_RespTop() != s_AckTop && fuzz_RespAt(s_AckTop) != 0xFA)
+		fail("%02X answered with %02X instead of ACK", s_AckRx, fuzz_RespAt(s_AckTop));
+	return;
+}
+
+static void onRxState(const int st)
+{
+	checkAck();
+	if (st == FUZZ_RXST_IDOL)
+		s_IdleAt = g_SimNow;
+	else
+		checkIdle();
+	if (!fuzz_BuffSane())
+		fail("send buffer overflow");
+	return;
+}
+
+static void onTxDone(const uint8_t dt)
+{
+	s_LastTx = dt;
+	return;
+}
+
+// デバイスが受け取ったバイトから、引数を待っているかをたどる
+static void onRxDone(const uint8_t dt)
+{
+	bool bAck = false;
+	if (dt == 0xFE)
+		;	// 引数を待ったまま
+	else if (s_WaitArg != 0 && dt < 0xED) {
+		// F0 の引数は 0〜3 だけ。ほかは FE を返して、また引数を待つ
+		bAck = (s_WaitArg != 0xF0 || dt <= 3);
+		if (bAck)
+			s_WaitArg = 0;
+	}
+	else if (dt == 0xED || dt == 0xF0 || dt == 0xF3) {
+		s_WaitArg = dt;
+		bAck = true;
+	}
+	else
+		s_WaitArg = 0;
+	if (bAck) {
+		s_bAckCheck = true;
+		s_AckRx = dt;
+		s_AckTop = fuzz_RespTop();
+	}
+	return;
+}
+
+static const struct SIM_OBSERVER s_Observer = { .onTxDone = onTxDone, .onRxDone = onRxDone, .onRxState = onRxState };
+
+// ホストのラインの操作（ホストモデルとは別に動かす）。時刻 t に CLK、DAT を clk、dat にする
+struct GLITCH
+{
+	simtime_t t;
+	uint8_t clk;
+	uint8_t dat;
+};
+static struct GLITCH s_Glitch[FUZZ_INPUT_MAX];
+static int s_GlitchHead, s_GlitchNum;
+
+static void glitchAdd(const simtime_t t, const int clk, const int dat)
+{
+	s_Glitch[s_GlitchHead + s_GlitchNum++] = (struct GLITCH){ t, (uint8_t)clk, (uint8_t)dat };
+	return;
+}
+
+static simtime_t glitchNextEvent(void)
+{
+	return (s_GlitchNum != 0) ? s_Glitch[s_GlitchHead].t : SIM_NEVER;
+}
+
+static void glitchOnTime(void)
+{
+	const struct GLITCH *g = &s_Glitch[s_GlitchHead++];
+	--s_GlitchNum;
+	mcu_HostOut(SIM_CLK, g->clk);
+	mcu_HostOut(SIM_DAT, g->dat);
+	return;
+}
+
+static const struct SIM_PEER s_GlitchPeer = { glitchNextEvent, glitchOnTime };
+
+static void hostSend(const uint8_t dt, const simtime_t t)
+{
+	if (FUZZ_HOST_TX_MAX <= s_HostTxNum)
+		return;
+	++s_HostTxNum;
+	host_SendAt(dt, t);
+	return;
+}
+
+// ファームウェアを時刻 t まで動かす
+static void runTo(const simtime_t t)
+{
+	if (g_SimNow < t)
+		sim_RunFor(t - g_SimNow);
+	checkIdle();
+	return;
+}
+
+static bool drained(void)
+{
+	return s_GlitchNum == 0 && host_TxIdle() && pc_OutPending() == 0;
+}
+
+static bool quiet(void)
+{
+	return host_TxIdle() && fuzz_TxQuiet();
+}
+
+static int s_WaitRx;
+static bool hostRxReached(void)
+{
+	return s_WaitRx <= host_RxNum();
+}
+
+static void runInput(const uint8_t *p, const size_t n)
+{
+	if (n == 0)
+		return;
+	s_Input = p;
+	s_InputLen = n;
+	int modelNum = 0;
+	while (g_HostModels[modelNum] != NULL)
+		++modelNum;
+
+	mcu_Reset();
+	pc_Reset();
+	host_Init(g_HostModels[p[0] % modelNum]);
+	mcu_AddPeer(&s_GlitchPeer);
+	mcu_AddObserver(&s_Observer);
+	s_GlitchHead = s_GlitchNum = 0;
+	s_IdleAt = 0;
+	s_LastTx = 0xAA;	// app.c は、電源投入時の自己診断の結果（AA）を送ったことにしている
+	s_HostTxNum = 0;
+	s_WaitArg = 0;
+	s_bAckCheck = false;
+	sim_Start();
+	sim_RunFor(SIM_MS(50));
+
+	simtime_t t = g_SimNow;		// 次の操作の時刻
+	bool bGlitch = false;
+	size_t i = 1;
+	const size_t end = (n < FUZZ_INPUT_MAX) ? n : FUZZ_INPUT_MAX;
+#define NEXT()	((i < end) ? p[i++] : 0)
+	while (i < end) {
+		const uint8_t op = p[i++];
+		if (op < 0x20) {
+			const simtime_t us = (simtime_t)(NEXT() + 1) << ((op >> 2) & 0x07);
+			glitchAdd(t, op & 0x01, (op >> 1) & 0x01);
+			bGlitch = true;
+			t += SIM_US(us);
+			continue;
+		}
+		if (bGlitch) {
+			glitchAdd(t, 1, 1);
+			bGlitch = false;
+		}
+		runTo(t);
+		if (op < 0x60)
+			hostSend(NEXT(), g_SimNow + SIM_US(100) * (op & 0x3F));
+		else if (op < 0x80) {
+			const simtime_t at = g_SimNow + SIM_US(100) * (op & 0x1F);
+			hostSend(0xED, at);
+			hostSend(NEXT(), at);
+		}
+		else if (op < 0xA0) {
+			for (int k = 0; k <= (op & 0x1F); ++k)
+				hostSend(0xFE, g_SimNow);
+		}
+		else {
+			uint8_t pkt[PC_MSG_MAX];
+			uint8_t len = 0;
+			if (op < 0xC0)
+				pkt[len++] = 'S';
+			const int num = (op < 0xC0) ? (op & 0x07) + 1 : (op & 0x0F) + 1;
+			for (int k = 0; k < num; ++k)
+				pkt[len++] = NEXT();
+			pc_Send(pkt, len);
+		}
+	}
+#undef NEXT
+	if (bGlitch)
+		glitchAdd(t, 1, 1);
+
+	// 操作がすべて終わるのを待ち、送信を止めて送信バッファを空にする
+	if (!sim_RunUntil(drained, FUZZ_DRAIN_MAX))
+		fail("host or PC did not finish sending");
+	// ホストが何もしなければ、FUZZ_IDLE_MAX のうちに RXST_IDOL に戻っているはず
+	sim_RunFor(FUZZ_IDLE_MAX);
+	checkIdle();
+	host_Send(0xF5);
+	if (!sim_RunUntil(quiet, FUZZ_QUIET_MAX))
+		fail("send buffer did not drain after F5");
+	checkIdle();
+	if (fuzz_LastDt() != s_LastTx)
+		fail("last sent byte %02X, but RESEND would send %02X", s_LastTx, fuzz_LastDt());
+	// 受信に戻れることと、RESEND で最後に送り終えたバイトが返ることを確かめる
+	const uint8_t last = s_LastTx;
+	const int idx = host_LogNum();
+	s_WaitRx = host_RxNum() + 1;
+	host_Send(0xFE);
+	if (!sim_RunUntil(hostRxReached, FUZZ_RESEND_MAX))
+		fail("no response to RESEND");
+	for (int k = idx; k < host_LogNum(); ++k) {
+		const struct HOSTBYTE *b = host_Log(k);
+		if (b->dir == HOSTDIR_TX && b->err != HOSTERR_NONE)
+			fail("host TX %02X error %d", b->dt, b->err);
+		if (b->dir == HOSTDIR_RX && b->err == HOSTERR_NONE && b->dt != last)
+			fail("RESEND returned %02X, expected %02X", b->dt, last);
+	}
+	return;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *p, size_t n);
+int LLVMFuzzerTestOneInput(const uint8_t *p, const size_t n)
+{
+	runInput(p, n);
+	return 0;
+}
+
+#if !defined(FUZZ_LIBFUZZER)
+static uint32_t s_Rand;
+static uint32_t fuzzRand(const uint32_t n)
+{
+	s_Rand = s_Rand * 1103515245 + 12345;
+	return (s_Rand >> 16) % n;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: ps2fuzz [-n count] [-s seed] [file...]\n");
+	return 2;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t buff[FUZZ_INPUT_MAX];
+	int count = 100;
+	s_Rand = 1;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+		if (strcmp(argv[arg], "-n") == 0)
+			count = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-s") == 0)
+			s_Rand = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+		else
+			return usage();
+	}
+	if (arg < argc) {
+		const int files = argc - arg;
+		for (; arg < argc; ++arg) {
+			FILE *fp = fopen(argv[arg], "rb");
+			if (fp == NULL) {
+				perror(argv[arg]);
+				return 2;
+			}
+			const size_t n = fread(buff, 1, sizeof(buff), fp);
+			fclose(fp);
+			runInput(buff, n);
+		}
+		printf("fuzz: ok (%d files)\n", files);
+		return 0;
+	}
+	// 乱数の入力は、ラインの操作が続きすぎないように短めにする
+	for (int t = 0; t < count; ++t) {
+		const size_t n = 1 + fuzzRand(256);
+		for (size_t k = 0; k < n; ++k)
+			buff[k] = (uint8_t)fuzzRand(256);
+		runInput(buff, n);
+	}
+	printf("fuzz: ok (%d inputs)\n", count);
+	return 0;
+}
+#endif
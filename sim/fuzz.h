@@ -0,0 +1,23 @@
+#ifndef SIM_FUZZ_H
+#define SIM_FUZZ_H
+
+/*********************************************************************
+* ファジング用に、app.c の static の変数を調べる関数（fuzz_app.c）
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FUZZ_RXST_IDOL		0	// app.c の taskReceivePS2() の RXST_IDOL
+
+// 送信バッファ（g_Buff、g_RespBuff）の長さが容量以下で、初期化したときのままか
+bool fuzz_BuffSane(void);
+// 送信していない、送信途中のレコードもない、送信バッファも空
+bool fuzz_TxQuiet(void);
+// 最後に終了ビットまで送り終えたデータ（g_Ps2Tx.lastDt。RESENDで再送する）
+uint8_t fuzz_LastDt(void);
+// 応答バッファ（g_RespBuff）の次に入れる位置（マスクしない）と、そこに入れたデータ
+uint8_t fuzz_RespTop(void);
+uint8_t fuzz_RespAt(uint8_t pos);
+
+#endif
@@ -0,0 +1,37 @@
+/*********************************************************************
+* ファジング用の app.c（fuzz.h）
+*	app.c をそのまま取り込み、static の変数を調べる関数を足す。ps2fuzz では app.c の代わりにリンクする。
+*/
+#include "../app.c"
+#include "fuzz.h"
+
+static bool buffSane(const struct RINGBUFF *p, const struct RINGENTRY *buff, const uint8_t size)
+{
+	return p->buff == buff && p->mask == size - 1 && t_LenBuff(p) <= size;
+}
+
+bool fuzz_BuffSane(void)
+{
+	return buffSane(&g_Buff, g_BuffEnt, RINGBUFF_SIZE) && buffSane(&g_RespBuff, g_RespBuffEnt, RESPBUFF_SIZE);
+}
+
+bool fuzz_TxQuiet(void)
+{
+	return !g_Ps2Tx.busy && !g_Ps2Tx.done && g_Ps2Tx.seqSent == 0
+		&& t_LenBuff(&g_Buff) == 0 && t_LenBuff(&g_RespBuff) == 0;
+}
+
+uint8_t fuzz_LastDt(void)
+{
+	return g_Ps2Tx.lastDt;
+}
+
+uint8_t fuzz_RespTop(void)
+{
+	return g_RespBuff.top;
+}
+
+uint8_t fuzz_RespAt(const uint8_t pos)
+{
+	return g_RespBuff.buff[pos & g_RespBuff.mask].dt;
+}
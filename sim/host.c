@@ -0,0 +1,348 @@
+/*********************************************************************
+* 仮想PS/2ホスト（host.h）
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+
+#define RX_BIT_TIMEOUT		SIM_US(1000)	// フレームの途中で次のCLKの立下りを待つ時間
+#define TX_START_TIMEOUT	SIM_MS(15)		// 送信要求からデバイスがクロックを出すまで
+#define TX_FRAME_TIMEOUT	SIM_MS(2)		// クロックが始まってから応答ビットまで
+#define TX_RTS_HOLD			SIM_US(10)		// DAT=L にしてから CLK を離すまで
+#define RX_CLK_JITTER		SIM_US(1)		// minClkUs の余裕。デバイスの割込みの処理の長さで、CLKの立下りは数サイクル揺れる
+#define TXQUEUE_SIZE		256
+
+// CLKの周期の最短（minClkUs）は、どれも実機で測った値ではなく、PS/2の規格の最短（60us）
+const struct HOSTMODEL HOSTMODEL_GENERIC = { "generic", HOSTRTS_CLK_DAT, 100, 100, false, 0, 0, 60 };
+// 送信要求は CLK=H、DAT=L。デバイスの送信が終わるのを待ってから出す
+const struct HOSTMODEL HOSTMODEL_OCM382 = { "ocm-3.8.2", HOSTRTS_DAT, 0, 100, false, 0, 0, 60 };
+// 送信要求は CLK=L、DAT=L。デバイスの送信中でも、送りたくなったらすぐ CLK=L にする
+const struct HOSTMODEL HOSTMODEL_OCM39X = { "ocm-3.9.x", HOSTRTS_CLK_DAT, 100, 0, true, 0, 0, 60 };
+// DATの変化からCLKの立下りまでの余裕と、ブレークコードの１バイト目と２バイト目の間隔が必要
+const struct HOSTMODEL HOSTMODEL_DE0 = { "de0-deocm", HOSTRTS_CLK_DAT, 100, 100, false, 1, 1000, 60 };
+
+const struct HOSTMODEL *const g_HostModels[] = {
+	&HOSTMODEL_GENERIC, &HOSTMODEL_OCM382, &HOSTMODEL_OCM39X, &HOSTMODEL_DE0, NULL
+};
+
+enum TXST
+{
+	TX_IDLE,
+	TX_INHIBIT,		// CLK=L にしている
+	TX_RTS_DAT,		// CLK=L、DAT=L にしている
+	TX_RTS,			// DAT=L のまま CLK を離し、デバイスのクロックを待っている
+	TX_BITS,		// デバイスのクロックでビットを出している
+};
+
+static const struct HOSTMODEL *s_Model;
+
+static int s_RxBit;				// フレームのうち受け取ったビット数
+static uint16_t s_RxShift;
+static enum HOSTERR s_RxErr;	// フレームの途中で見つけたエラー（HOSTERR_SETUP、HOSTERR_GAP、HOSTERR_CLKFAST）
+static simtime_t s_RxLastFall;	// フレームの前のCLKの立下り
+static simtime_t s_RxTimeoutAt;
+static simtime_t s_LastClkEdge;
+static simtime_t s_LastDatEdge;
+static simtime_t s_LastRxEnd;	// 最後にエラーなく受け取ったフレームの終わり
+static uint8_t s_LastRxDt;
+static uint32_t s_Interrupted;
+
+static enum TXST s_TxSt;
+static int s_TxBit;				// 送信中のフレームで数えたCLKの立下り
+static uint8_t s_TxDt;
+static int s_TxLogIdx;
+static simtime_t s_TxAt;		// 送信の次の動作、またはタイムアウトの時刻
+static uint8_t s_TxQueue[TXQUEUE_SIZE];
+static simtime_t s_TxQueueAt[TXQUEUE_SIZE];	// この時刻より前には送り始めない
+static uint8_t s_TxHead, s_TxTail;
+
+static struct HOSTBYTE *s_Log;
+static int s_LogNum;
+static int s_LogCap;
+static int s_RxNum;
+static uint32_t s_Err[HOSTERR_NUM];
+
+static int addLog(const uint8_t dir, const uint8_t dt, const uint8_t err)
+{
+	if (s_LogNum == s_LogCap) {
+		s_LogCap = (s_LogCap == 0) ? 4096 : s_LogCap * 2;
+		s_Log = realloc(s_Log, sizeof(*s_Log) * (size_t)s_LogCap);
+		if (s_Log == NULL)
+			abort();
+	}
+	struct HOSTBYTE *p = &s_Log[s_LogNum];
+	p->t = g_SimNow;
+	p->tEnd = g_SimNow;
+	p->dt = dt;
+	p->dir = dir;
+	p->err = err;
+	++s_Err[err];
+	return s_LogNum++;
+}
+
+static int oddParity(const uint8_t dt)
+{
+	return !__builtin_parity(dt);
+}
+
+static void rxBit(void)
+{
+	if (s_Model->datSetupUs != 0 && g_SimNow - s_LastDatEdge < SIM_US(s_Model->datSetupUs))
+		s_RxErr = HOSTERR_SETUP;
+	if (s_RxBit == 0 && s_Model->breakGapUs != 0 && s_LastRxDt == 0xF0
+		&& g_SimNow - s_LastRxEnd < SIM_US(s_Model->breakGapUs) && s_RxErr == HOSTERR_NONE)
+		s_RxErr = HOSTERR_GAP;
+	if (s_RxBit != 0 && s_Model->minClkUs != 0 && g_SimNow - s_RxLastFall + RX_CLK_JITTER < SIM_US(s_Model->minClkUs)
+		&& s_RxErr == HOSTERR_NONE)
+		s_RxErr = HOSTERR_CLKFAST;
+	s_RxLastFall = g_SimNow;
+	s_RxShift |= (uint16_t)(mcu_Level(SIM_DAT) << s_RxBit);
+	++s_RxBit;
+	s_RxTimeoutAt = g_SimNow + RX_BIT_TIMEOUT;
+	if (s_RxBit < 11)
+		return;
+	const uint8_t dt = (uint8_t)(s_RxShift >> 1);
+	enum HOSTERR err = s_RxErr;
+	if (err != HOSTERR_NONE)
+		;		// このホストでは正しく受け取れない
+	else if (s_RxShift & 0x0001)
+		err = HOSTERR_START;
+	else if (((s_RxShift >> 9) & 1) != oddParity(dt))
+		err = HOSTERR_PARITY;
+	else if (!(s_RxShift & 0x0400))
+		err = HOSTERR_STOP;
+	addLog(HOSTDIR_RX, dt, (uint8_t)err);
+	if (err == HOSTERR_NONE) {
+		++s_RxNum;
+		s_LastRxEnd = g_SimNow;
+		s_LastRxDt = dt;
+	}
+	s_RxBit = 0;
+	s_RxShift = 0;
+	s_RxErr = HOSTERR_NONE;
+	s_RxTimeoutAt = SIM_NEVER;
+	return;
+}
+
+static void txEnd(const enum HOSTERR err)
+{
+	s_Log[s_TxLogIdx].tEnd = g_SimNow;
+	if (err != HOSTERR_NONE) {
+		--s_Err[s_Log[s_TxLogIdx].err];
+		s_Log[s_TxLogIdx].err = (uint8_t)err;
+		++s_Err[err];
+	}
+	mcu_HostOut(SIM_CLK, 1);
+	mcu_HostOut(SIM_DAT, 1);
+	s_TxSt = TX_IDLE;
+	s_TxAt = SIM_NEVER;
+	return;
+}
+
+// デバイスのクロックで次のビットを出す。ビットはCLK=Lの間に変え、デバイスはCLK=Hの間に読む
+static void txBit(void)
+{
+	++s_TxBit;
+	s_TxSt = TX_BITS;
+	s_TxAt = g_SimNow + TX_FRAME_TIMEOUT;
+	if (s_TxBit <= 8)
+		mcu_HostOut(SIM_DAT, (s_TxDt >> (s_TxBit - 1)) & 1);
+	else if (s_TxBit == 9)
+		mcu_HostOut(SIM_DAT, oddParity(s_TxDt));
+	else if (s_TxBit == 10)
+		mcu_HostOut(SIM_DAT, 1);		// 終了ビット
+	else
+		txEnd(mcu_Level(SIM_DAT) == 0 ? HOSTERR_NONE : HOSTERR_NOACK);
+	return;
+}
+
+static void onLine(const enum SIM_LINE line, const int level)
+{
+	if (line != SIM_CLK) {
+		s_LastDatEdge = g_SimNow;
+		return;
+	}
+	s_LastClkEdge = g_SimNow;
+	if (level != 0)
+		return;
+	switch (s_TxSt) {
+		case TX_INHIBIT:
+		case TX_RTS_DAT:
+			break;		// 自分で CLK=L にした
+		case TX_RTS:
+		case TX_BITS:
+			txBit();
+			break;
+		case TX_IDLE:
+			rxBit();
+			break;
+	}
+	return;
+}
+
+static bool txCanStart(void)
+{
+	if (s_TxSt != TX_IDLE || s_TxHead == s_TxTail)
+		return false;
+	if (s_Model->bInterrupt)
+		return true;
+	return s_RxBit == 0 && mcu_Level(SIM_CLK) == 1 && mcu_Level(SIM_DAT) == 1;
+}
+
+// 次のバイトを送り始められる時刻（txCanStart() のとき）
+static simtime_t txStartAt(void)
+{
+	const simtime_t t = s_LastClkEdge + SIM_US(s_Model->idleUs);
+	return (t < s_TxQueueAt[s_TxHead]) ? s_TxQueueAt[s_TxHead] : t;
+}
+
+static simtime_t nextEvent(void)
+{
+	simtime_t t = s_RxTimeoutAt;
+	if (s_TxAt < t)
+		t = s_TxAt;
+	if (txCanStart() && txStartAt() < t)
+		t = txStartAt();
+	return t;
+}
+
+static void onTime(void)
+{
+	if (s_RxTimeoutAt <= g_SimNow) {
+		addLog(HOSTDIR_RX, (uint8_t)(s_RxShift >> 1), HOSTERR_TIMEOUT);
+		s_RxBit = 0;
+		s_RxShift = 0;
+		s_RxErr = HOSTERR_NONE;
+		s_RxTimeoutAt = SIM_NEVER;
+	}
+	if (s_TxAt <= g_SimNow) {
+		switch (s_TxSt) {
+			case TX_INHIBIT:
+				s_TxSt = TX_RTS_DAT;
+				s_TxAt = g_SimNow + TX_RTS_HOLD;
+				mcu_HostOut(SIM_DAT, 0);
+				break;
+			case TX_RTS_DAT:
+				s_TxSt = TX_RTS;
+				s_TxAt = g_SimNow + TX_START_TIMEOUT;
+				mcu_HostOut(SIM_CLK, 1);
+				break;
+			default:
+				txEnd(HOSTERR_TXTIMEOUT);
+				break;
+		}
+	}
+	if (txCanStart() && txStartAt() <= g_SimNow) {
+		if (s_RxBit != 0) {
+			// 受信中のフレームは捨てる（デバイスは送信禁止を見て送りなおす）
+			++s_Interrupted;
+			s_RxBit = 0;
+			s_RxShift = 0;
+			s_RxErr = HOSTERR_NONE;
+			s_RxTimeoutAt = SIM_NEVER;
+		}
+		s_TxDt = s_TxQueue[s_TxHead++];
+		s_TxLogIdx = addLog(HOSTDIR_TX, s_TxDt, HOSTERR_NONE);
+		s_TxBit = 0;
+		if (s_Model->rts == HOSTRTS_DAT) {
+			s_TxSt = TX_RTS;
+			s_TxAt = g_SimNow + TX_START_TIMEOUT;
+			mcu_HostOut(SIM_DAT, 0);
+		}
+		else {
+			s_TxSt = TX_INHIBIT;
+			s_TxAt = g_SimNow + SIM_US(s_Model->inhibitUs);
+			mcu_HostOut(SIM_CLK, 0);
+		}
+	}
+	return;
+}
+
+static const struct SIM_OBSERVER s_Observer = { .onLine = onLine };
+static const struct SIM_PEER s_Peer = { nextEvent, onTime };
+
+void host_Init(const struct HOSTMODEL *model)
+{
+	s_Model = model;
+	s_RxBit = 0;
+	s_RxShift = 0;
+	s_RxErr = HOSTERR_NONE;
+	s_RxTimeoutAt = SIM_NEVER;
+	s_LastClkEdge = 0;
+	s_LastDatEdge = 0;
+	s_LastRxEnd = 0;
+	s_LastRxDt = 0;
+	s_Interrupted = 0;
+	s_TxSt = TX_IDLE;
+	s_TxAt = SIM_NEVER;
+	s_TxHead = s_TxTail = 0;
+	s_LogNum = 0;
+	s_RxNum = 0;
+	for (int t = 0; t < HOSTERR_NUM; ++t)
+		s_Err[t] = 0;
+	mcu_AddObserver(&s_Observer);
+	mcu_AddPeer(&s_Peer);
+	return;
+}
+
+const struct HOSTMODEL *host_Model(void)
+{
+	return s_Model;
+}
+
+void host_Send(const uint8_t dt)
+{
+	host_SendAt(dt, g_SimNow);
+	return;
+}
+
+void host_SendAt(const uint8_t dt, const simtime_t t)
+{
+	if ((uint8_t)(s_TxTail + 1) == s_TxHead) {
+		fprintf(stderr, "host: TX queue overflow\n");
+		abort();
+	}
+	s_TxQueueAt[s_TxTail] = t;
+	s_TxQueue[s_TxTail++] = dt;
+	return;
+}
+
+bool host_TxIdle(void)
+{
+	return s_TxSt == TX_IDLE && s_TxHead == s_TxTail;
+}
+
+int host_LogNum(void)
+{
+	return s_LogNum;
+}
+
+const struct HOSTBYTE *host_Log(const int idx)
+{
+	return &s_Log[idx];
+}
+
+int host_RxNum(void)
+{
+	return s_RxNum;
+}
+
+uint32_t host_ErrCount(const enum HOSTERR err)
+{
+	return s_Err[err];
+}
+
+uint32_t host_InterruptCount(void)
+{
+	return s_Interrupted;
+}
+
+const struct HOSTMODEL *host_FindModel(const char *name)
+{
+	for (int i = 0; g_HostModels[i] != NULL; ++i) {
+		if (strcmp(g_HostModels[i]->name, name) == 0)
+			return g_HostModels[i];
+	}
+	return NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef SIM_HOST_H
+#define SIM_HOST_H
+
+/*********************************************************************
+* 仮想PS/2ホスト
+*	CLK、DATのラインをシミュレーションの時刻で見て、デバイス（PS2VKBD）が送ったフレームを
+*	CLKの立下りごとにDATを読んで受け取り、ホストからのコマンドは送信要求を出してデバイスのクロックで送る。
+*	受け取ったバイト、送ったバイトは時刻とエラーとともに記録する。
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcu.h"
+
+// 送信要求の出し方
+enum HOSTRTS
+{
+	HOSTRTS_CLK_DAT,	// CLK=L にして inhibitUs 待ち、DAT=L にしてから CLK を離す
+	HOSTRTS_DAT,		// CLK=H のまま DAT=L にする
+};
+
+// ホストの動作の違い（app.c の taskReceivePS2() の前のコメントにある、動作確認の対象のホスト）
+struct HOSTMODEL
+{
+	const char *name;
+	uint8_t rts;			// HOSTRTS_*
+	uint16_t inhibitUs;		// HOSTRTS_CLK_DAT で、DAT=L にする前に CLK=L にしておく時間
+	uint16_t idleUs;		// 送信要求を出す前に、CLKが動いていない時間
+	bool bInterrupt;		// デバイスが送信している途中でも送信要求を出す（受信中のフレームは捨てる）
+	uint8_t datSetupUs;		// CLKの立下りの前に、DATが変わっていてはいけない時間（0:見ない）
+	uint16_t breakGapUs;	// F0 を受け取ってから、次のフレームのCLKの立下りまでに必要な時間（0:見ない）
+	uint8_t minClkUs;		// 受け取れるCLKの周期の最短（立下りから次の立下りまで。0:見ない）。
+							// デバイスの 'R' で、ここまで速くしてよい
+};
+extern const struct HOSTMODEL HOSTMODEL_GENERIC;	// PS/2の規格どおりのホスト
+extern const struct HOSTMODEL HOSTMODEL_OCM382;		// SX-2 OCM-PLD 3.8.2
+extern const struct HOSTMODEL HOSTMODEL_OCM39X;		// SX-2 OCM-PLD 3.9.0、3.9.1
+extern const struct HOSTMODEL HOSTMODEL_DE0;		// DE0＋DEOCM
+extern const struct HOSTMODEL *const g_HostModels[];	// 上のすべて。NULL で終わる
+const struct HOSTMODEL *host_FindModel(const char *name);
+
+enum HOSTERR
+{
+	HOSTERR_NONE,
+	HOSTERR_START,		// スタートビットが1
+	HOSTERR_PARITY,
+	HOSTERR_STOP,		// 終了ビットが0
+	HOSTERR_TIMEOUT,	// フレームの途中でクロックが止まった
+	HOSTERR_NOACK,		// 送信したバイトに応答ビットが返らなかった
+	HOSTERR_TXTIMEOUT,	// 送信要求に対してデバイスがクロックを出さなかった
+	HOSTERR_SETUP,		// CLKの立下りの直前にDATが変わった（datSetupUs）
+	HOSTERR_GAP,		// F0 の次のフレームが早すぎて受け取れなかった（breakGapUs）
+	HOSTERR_CLKFAST,	// CLKの周期が短すぎた（minClkUs）
+	HOSTERR_NUM
+};
+
+enum HOSTDIR { HOSTDIR_RX, HOSTDIR_TX };
+
+struct HOSTBYTE
+{
+	simtime_t t;		// 受信はフレームの終わり、送信は送信要求を出した時刻
+	simtime_t tEnd;		// 送信で応答ビットを受け取った時刻
+	uint8_t dt;
+	uint8_t dir;		// HOSTDIR_*
+	uint8_t err;		// HOSTERR_*
+};
+
+void host_Init(const struct HOSTMODEL *model);
+const struct HOSTMODEL *host_Model(void);
+// dt をデバイスへ送る（送信待ちの列に入れる）
+void host_Send(uint8_t dt);
+// 時刻 t より後に dt を送る。メインループの区切りとは関係のない時刻に送信要求を出すのに使う
+void host_SendAt(uint8_t dt, simtime_t t);
+bool host_TxIdle(void);			// 送信待ちも送信中のバイトもない
+// 記録
+int host_LogNum(void);
+const struct HOSTBYTE *host_Log(int idx);
+int host_RxNum(void);			// 受け取ったバイトの数（エラーを除く）
+uint32_t host_ErrCount(enum HOSTERR err);
+uint32_t host_InterruptCount(void);	// 送信要求のために途中で捨てたフレームの数（bInterrupt）
+
+#endif
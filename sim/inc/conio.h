@@ -0,0 +1,4 @@
+#ifndef SIM_CONIO_H
+#define SIM_CONIO_H
+// mcc.h がインクルードする XC8 のヘッダ。シミュレーションでは使うものがない
+#endif
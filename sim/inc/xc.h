@@ -0,0 +1,174 @@
+#ifndef SIM_XC_H
+#define SIM_XC_H
+
+/*********************************************************************
+* ホストPC（Linux）でビルドするための <xc.h> の代わり
+*	app.c、main.c、mcc_generated_files、cdc が使うPIC18F14K50のレジスタと、XC8の組み込み関数だけを定義する。
+*	レジスタは普通の変数（sfr.c）で、ビット名は本物と同じ位置になるようにビットフィールドで定義する。
+*	時刻に関係するもの（TMR1の読み出し、__delay_us()）は、シミュレーションの時刻（mcu.c）を進める関数にする。
+*	USBのSIEが書き換えるレジスタ（UIR、USTAT）は、偽のSIE（usb/sie_fake.c）の関数を通して読み書きする。
+*/
+
+#include <stdint.h>
+
+// 固定アドレスには置けないので、アドレスのビット演算（BDTのピンポンの切り替え）が本物と同じになるように揃える
+#define __at(addr)				__attribute__((aligned(256)))
+#define __interrupt(...)
+#define __bit					_Bool
+#define Nop()					((void)0)
+#define CLRWDT()				((void)0)
+#define di()					(INTCONbits.GIE = 0)
+#define ei()					(INTCONbits.GIE = 1)
+
+// 時間の経過。引数は定数でなくてもよい（本物は定数でなければならない）
+void sim_DelayCycles(uint32_t cycles);
+#define __delay_us(us)			sim_DelayCycles((uint32_t)(us) * 12)
+#define __delay_ms(ms)			sim_DelayCycles((uint32_t)(ms) * 12000)
+
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t LATC0:1, LATC1:1, LATC2:1, LATC3:1, LATC4:1, LATC5:1, LATC6:1, LATC7:1; };
+	struct { uint8_t LC0:1, LC1:1, LC2:1, LC3:1, LC4:1, LC5:1, LC6:1, LC7:1; };
+} SIM_LATC_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t RABIF:1, INT0IF:1, TMR0IF:1, RABIE:1, INT0IE:1, TMR0IE:1, PEIE:1, GIE:1; };
+	struct { uint8_t :6, GIEL:1, GIEH:1; };
+} SIM_INTCON_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t RABIP:1, :1, TMR0IP:1, :1, INTEDG2:1, INTEDG1:1, INTEDG0:1, nRABPU:1; };
+} SIM_INTCON2_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t INT1IF:1, INT2IF:1, :1, INT1IE:1, INT2IE:1, :1, INT1IP:1, INT2IP:1; };
+} SIM_INTCON3_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t TMR1IF:1, TMR2IF:1, CCP1IF:1, SSPIF:1, TXIF:1, RCIF:1, ADIF:1, :1; };
+	struct { uint8_t TMR1IE:1, TMR2IE:1, CCP1IE:1, SSPIE:1, TXIE:1, RCIE:1, ADIE:1, :1; };
+	struct { uint8_t TMR1IP:1, TMR2IP:1, CCP1IP:1, SSPIP:1, TXIP:1, RCIP:1, ADIP:1, :1; };
+} SIM_PIR1_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t :1, TMR3IF:1, USBIF:1, BCLIF:1, EEIF:1, C2IF:1, C1IF:1, OSCFIF:1; };
+	struct { uint8_t :1, TMR3IE:1, USBIE:1, BCLIE:1, EEIE:1, C2IE:1, C1IE:1, OSCFIE:1; };
+	struct { uint8_t :1, TMR3IP:1, USBIP:1, BCLIP:1, EEIP:1, C2IP:1, C1IP:1, OSCFIP:1; };
+} SIM_PIR2_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t nBOR:1, nPOR:1, nPD:1, nTO:1, nRI:1, :1, SBOREN:1, IPEN:1; };
+} SIM_RCON_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t TMR1ON:1, TMR1CS:1, T1SYNC:1, T1OSCEN:1, T1CKPS:2, T1RUN:1, RD16:1; };
+} SIM_T1CON_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t T2CKPS:2, TMR2ON:1, TOUTPS:4, :1; };
+} SIM_T2CON_t;
+
+extern volatile SIM_LATC_t SIM_LATC;
+extern volatile SIM_INTCON_t SIM_INTCON;
+extern volatile SIM_INTCON2_t SIM_INTCON2;
+extern volatile SIM_INTCON3_t SIM_INTCON3;
+extern volatile SIM_PIR1_t SIM_PIR1, SIM_PIE1, SIM_IPR1;
+extern volatile SIM_PIR2_t SIM_PIR2, SIM_PIE2, SIM_IPR2;
+extern volatile SIM_RCON_t SIM_RCON;
+extern volatile SIM_T1CON_t SIM_T1CON;
+extern volatile SIM_T2CON_t SIM_T2CON;
+extern volatile uint8_t PR2, TMR2;
+extern volatile uint8_t LATA, LATB, TRISA, TRISB, TRISC, ANSEL, ANSELH, WPUA, WPUB, IOCA, IOCB;
+extern volatile uint8_t OSCCON, OSCCON2, OSCTUNE;
+
+// PS/2のピン（RC0〜RC4）は PS2_PORT_HEADER（sim_port.h）で置き換えるので、PORTCは定義しない。
+// LATCは PIN_MANAGER_Initialize() が書くだけ。
+#define LATC			SIM_LATC.reg
+#define LATCbits		SIM_LATC
+#define INTCON			SIM_INTCON.reg
+#define INTCONbits		SIM_INTCON
+#define INTCON2			SIM_INTCON2.reg
+#define INTCON2bits		SIM_INTCON2
+#define INTCON3			SIM_INTCON3.reg
+#define INTCON3bits		SIM_INTCON3
+#define PIR1			SIM_PIR1.reg
+#define PIR1bits		SIM_PIR1
+#define PIE1			SIM_PIE1.reg
+#define PIE1bits		SIM_PIE1
+#define IPR1			SIM_IPR1.reg
+#define IPR1bits		SIM_IPR1
+#define PIR2			SIM_PIR2.reg
+#define PIR2bits		SIM_PIR2
+#define PIE2			SIM_PIE2.reg
+#define PIE2bits		SIM_PIE2
+#define IPR2			SIM_IPR2.reg
+#define IPR2bits		SIM_IPR2
+#define RCON			SIM_RCON.reg
+#define RCONbits		SIM_RCON
+#define T1CON			SIM_T1CON.reg
+#define T1CONbits		SIM_T1CON
+#define T2CON			SIM_T2CON.reg
+#define T2CONbits		SIM_T2CON
+
+// TMR1はシミュレーションの時刻から作る。RD16が有効なので、TMR1Lを読むとTMR1Hがラッチされる
+volatile uint8_t *sim_Tmr1L(void);
+volatile uint8_t *sim_Tmr1H(void);
+#define TMR1L			(*sim_Tmr1L())
+#define TMR1H			(*sim_Tmr1H())
+
+/*********************************************************************
+* USBモジュール
+*/
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t :1, SUSPND:1, RESUME:1, USBEN:1, PKTDIS:1, SE0:1, PPBRST:1, :1; };
+} SIM_UCON_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t URSTIF:1, UERRIF:1, ACTVIF:1, TRNIF:1, IDLEIF:1, STALLIF:1, SOFIF:1, :1; };
+	struct { uint8_t URSTIE:1, UERRIE:1, ACTVIE:1, TRNIE:1, IDLEIE:1, STALLIE:1, SOFIE:1, :1; };
+} SIM_UIR_t;
+typedef union
+{
+	uint8_t reg;
+	struct { uint8_t EPSTALL:1, EPINEN:1, EPOUTEN:1, EPCONDIS:1, EPHSHK:1, :3; };
+} SIM_UEP_t;
+
+extern volatile SIM_UIR_t SIM_UIE;
+extern volatile uint8_t UEIR, UEIE, UADDR, UCFG;
+extern volatile SIM_UEP_t SIM_UEP[16];
+
+volatile SIM_UCON_t *sim_UCON(void);
+extern uint32_t g_SimPpbRst;		// PPBRST が1のときにUCONを読み書きした回数（sfr.c）
+volatile SIM_UIR_t *sim_UIR(void);
+volatile uint8_t *sim_USTAT(void);
+#define UCON			(sim_UCON()->reg)
+#define UCONbits		(*sim_UCON())
+#define UIR				(sim_UIR()->reg)
+#define UIRbits			(*sim_UIR())
+#define UIE				SIM_UIE.reg
+#define UIEbits			SIM_UIE
+#define USTAT			(*sim_USTAT())
+#define UEP0			SIM_UEP[0].reg
+#define UEP0bits		SIM_UEP[0]
+#define UEP1			SIM_UEP[1].reg
+#define UEP2			SIM_UEP[2].reg
+
+// BDTのバッファアドレスは16ビットなので、ホストPCのポインタとは表を通して変換する（usb/sie_fake.c）
+uint16_t sim_UsbPhysAddr(const volatile void *p);
+void *sim_UsbVirtAddr(uint16_t adr);
+#define ConvertToPhysicalAddress(a)	sim_UsbPhysAddr(a)
+#define ConvertToVirtualAddress(a)	sim_UsbVirtAddr(a)
+
+#endif
@@ -0,0 +1,381 @@
+/*********************************************************************
+* PIC18F14K50 とPS/2ラインのシミュレーション（mcu.h）
+*/
+#include <xc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mcu.h"
+
+// 割込みの入口と出口（コンテキストの退避と復帰を含む）にかかるサイクル数。XC8の出力からの概算
+#define ISR_ENTRY_CYC	24
+#define ISR_EXIT_CYC	16
+// ピンの読み書きにかかるサイクル数
+#define PIN_IN_CYC		2
+#define PIN_OUT_CYC		1
+// TMR1_ReadTimer() の呼び出し（TMR1Lを読むまで、TMR1Hを読むまで）
+#define TMR1L_CYC		6
+#define TMR1H_CYC		2
+#define TMR2_TICK_CYC	4		// Fosc/4 の 1:4
+#define TMR1_TICK_CYC	8		// Fosc/4 の 1:8
+
+#define OBSERVER_MAX	8
+#define PEER_MAX		4
+
+simtime_t g_SimNow;
+
+struct LINE
+{
+	int dev;			// ファームウェアの出力。1:離している、0:Lにしている
+	int host;			// ホストの出力
+	int level;			// ラインのレベル
+	simtime_t riseCyc;	// 立ち上がり時間
+	simtime_t riseAt;	// Hになる時刻。立ち上がり中でなければ SIM_NEVER
+};
+static struct LINE s_Line[SIM_LINE_NUM];
+static bool s_Power = true;
+static bool s_InIsr;
+
+static const struct SIM_OBSERVER *s_Obs[OBSERVER_MAX];
+static int s_ObsNum;
+static const struct SIM_PEER *s_Peers[PEER_MAX];
+static int s_PeerNum;
+
+// TMR2は、動作中はある時刻（base）にある値（baseVal）だったとして時刻から値を求める
+static struct
+{
+	bool on;
+	simtime_t base;
+	uint8_t baseVal;
+	uint8_t shadow;		// 最後にシミュレーションが書いた TMR2。違っていればファームウェアが書いた
+} s_T2;
+
+static uint8_t s_Tmr1L;
+static uint8_t s_Tmr1HLatch;
+static bool s_Tmr1Reading;			// メインループが TMR1L を読んで、まだ TMR1H を読んでいない
+static uint32_t s_Tmr1Corrupt;
+
+void INTERRUPT_InterruptManager(void);
+
+void mcu_AddObserver(const struct SIM_OBSERVER *p)
+{
+	if (OBSERVER_MAX <= s_ObsNum) {
+		fprintf(stderr, "mcu: too many observers\n");
+		abort();
+	}
+	s_Obs[s_ObsNum++] = p;
+	return;
+}
+
+void mcu_AddPeer(const struct SIM_PEER *p)
+{
+	if (PEER_MAX <= s_PeerNum) {
+		fprintf(stderr, "mcu: too many peers\n");
+		abort();
+	}
+	s_Peers[s_PeerNum++] = p;
+	return;
+}
+
+void mcu_Reset(void)
+{
+	g_SimNow = 0;
+	s_InIsr = false;
+	s_ObsNum = 0;
+	s_PeerNum = 0;
+	s_Power = true;
+	for (int t = 0; t < SIM_LINE_NUM; ++t) {
+		s_Line[t].dev = 1;
+		s_Line[t].host = 1;
+		s_Line[t].level = 1;
+		s_Line[t].riseCyc = SIM_US(3);
+		s_Line[t].riseAt = SIM_NEVER;
+	}
+	s_T2.on = false;
+	s_Tmr1Reading = false;
+	s_Tmr1Corrupt = 0;
+	return;
+}
+
+void mcu_SetRise(const simtime_t clkCyc, const simtime_t datCyc)
+{
+	s_Line[SIM_CLK].riseCyc = clkCyc;
+	s_Line[SIM_DAT].riseCyc = datCyc;
+	return;
+}
+
+simtime_t mcu_Rise(const enum SIM_LINE line)
+{
+	return s_Line[line].riseCyc;
+}
+
+void mcu_SetPower(const bool on)
+{
+	s_Power = on;
+	return;
+}
+
+static void setLevel(const enum SIM_LINE line, const int level)
+{
+	struct LINE *p = &s_Line[line];
+	if (p->level == level)
+		return;
+	p->level = level;
+	// INT0（RC0 = DAT）のエッジ検出。INTEDG0=0 なら立下り
+	if (line == SIM_DAT && level == INTCON2bits.INTEDG0)
+		INTCONbits.INT0IF = 1;
+	for (int t = 0; t < s_ObsNum; ++t) {
+		if (s_Obs[t]->onLine != NULL)
+			s_Obs[t]->onLine(line, level);
+	}
+	return;
+}
+
+// 出力が変わったときにラインのレベルを決めなおす
+static void updateLine(const enum SIM_LINE line)
+{
+	struct LINE *p = &s_Line[line];
+	if (p->dev == 0 || p->host == 0) {
+		p->riseAt = SIM_NEVER;
+		setLevel(line, 0);
+	}
+	else if (p->level == 0 && p->riseAt == SIM_NEVER) {
+		p->riseAt = g_SimNow + p->riseCyc;
+		if (p->riseCyc == 0) {
+			p->riseAt = SIM_NEVER;
+			setLevel(line, 1);
+		}
+	}
+	return;
+}
+
+static uint8_t tmr2Count(const simtime_t t)
+{
+	return (uint8_t)(s_T2.baseVal + (t - s_T2.base) / TMR2_TICK_CYC);
+}
+
+// ファームウェアが書いた T2CON、TMR2 を反映する
+static void tmr2Sync(void)
+{
+	if (T2CONbits.TMR2ON) {
+		if (!s_T2.on) {
+			s_T2.on = true;
+			s_T2.base = g_SimNow;
+			s_T2.baseVal = TMR2;
+		}
+		else if (TMR2 != s_T2.shadow) {
+			s_T2.base = g_SimNow;
+			s_T2.baseVal = TMR2;
+		}
+		else {
+			// 途中までの値を確定させておく（PR2が書き換えられても一致の時刻を正しく求めるため）
+			const uint8_t cnt = tmr2Count(g_SimNow);
+			s_T2.base += (simtime_t)(uint8_t)(cnt - s_T2.baseVal) * TMR2_TICK_CYC;
+			s_T2.baseVal = cnt;
+		}
+		TMR2 = s_T2.shadow = s_T2.baseVal;
+	}
+	else if (s_T2.on) {
+		s_T2.on = false;
+		TMR2 = s_T2.shadow = tmr2Count(g_SimNow);
+	}
+	return;
+}
+
+// 次にTMR2がPR2と一致して0に戻る時刻
+static simtime_t tmr2MatchAt(void)
+{
+	if (!s_T2.on)
+		return SIM_NEVER;
+	const unsigned ticks = (s_T2.baseVal <= PR2) ? (unsigned)(PR2 - s_T2.baseVal + 1) : (unsigned)(256 - s_T2.baseVal + PR2 + 1);
+	return s_T2.base + (simtime_t)ticks * TMR2_TICK_CYC;
+}
+
+static bool interruptPending(void)
+{
+	if (!INTCONbits.GIE)
+		return false;
+	if (INTCONbits.INT0IE && INTCONbits.INT0IF)
+		return true;
+	return INTCONbits.PEIE && PIE1bits.TMR2IE && PIR1bits.TMR2IF;
+}
+
+static void serviceInterrupt(void)
+{
+	if (s_InIsr || !interruptPending())
+		return;
+	s_InIsr = true;
+	INTCONbits.GIE = 0;
+	mcu_Advance(ISR_ENTRY_CYC);
+	INTERRUPT_InterruptManager();
+	mcu_Advance(ISR_EXIT_CYC);
+	INTCONbits.GIE = 1;		// RETFIE
+	s_InIsr = false;
+	return;
+}
+
+void mcu_AdvanceTo(const simtime_t target)
+{
+	for (;;) {
+		serviceInterrupt();
+		tmr2Sync();
+		if (target <= g_SimNow)
+			break;
+		simtime_t next = target;
+		for (int t = 0; t < SIM_LINE_NUM; ++t) {
+			if (s_Line[t].riseAt < next)
+				next = s_Line[t].riseAt;
+		}
+		const simtime_t match = tmr2MatchAt();
+		if (match < next)
+			next = match;
+		for (int t = 0; t < s_PeerNum; ++t) {
+			const simtime_t peer = s_Peers[t]->nextEvent();
+			if (peer < next)
+				next = (peer < g_SimNow) ? g_SimNow : peer;
+		}
+		g_SimNow = next;
+		for (int t = 0; t < SIM_LINE_NUM; ++t) {
+			if (s_Line[t].riseAt <= g_SimNow) {
+				s_Line[t].riseAt = SIM_NEVER;
+				setLevel((enum SIM_LINE)t, 1);
+			}
+		}
+		if (match <= g_SimNow) {
+			PIR1bits.TMR2IF = 1;
+			s_T2.base = match;
+			s_T2.baseVal = 0;
+			TMR2 = s_T2.shadow = 0;
+		}
+		for (int t = 0; t < s_PeerNum; ++t) {
+			if (s_Peers[t]->nextEvent() <= g_SimNow)
+				s_Peers[t]->onTime();
+		}
+	}
+	return;
+}
+
+void mcu_Advance(const simtime_t cyc)
+{
+	mcu_AdvanceTo(g_SimNow + cyc);
+	return;
+}
+
+void sim_DelayCycles(const uint32_t cycles)
+{
+	mcu_Advance(cycles);
+	return;
+}
+
+int mcu_Level(const enum SIM_LINE line)
+{
+	return s_Line[line].level;
+}
+
+static void notifyOut(const enum SIM_LINE line, const bool bHost, const int level)
+{
+	for (int t = 0; t < s_ObsNum; ++t) {
+		if (s_Obs[t]->onOut != NULL)
+			s_Obs[t]->onOut(line, bHost, level);
+	}
+	return;
+}
+
+void mcu_HostOut(const enum SIM_LINE line, const int level)
+{
+	const int v = level ? 1 : 0;
+	if (s_Line[line].host != v) {
+		s_Line[line].host = v;
+		notifyOut(line, true, v);
+	}
+	updateLine(line);
+	return;
+}
+
+void mcu_DevOut(const enum SIM_LINE line, const int lat)
+{
+	const int v = lat ? 0 : 1;
+	if (s_Line[line].dev != v) {
+		s_Line[line].dev = v;
+		notifyOut(line, false, v);
+	}
+	updateLine(line);
+	mcu_Advance(PIN_OUT_CYC);
+	return;
+}
+
+uint8_t mcu_DevIn(const enum SIM_LINE line)
+{
+	const uint8_t level = (uint8_t)s_Line[line].level;
+	mcu_Advance(PIN_IN_CYC);
+	return level;
+}
+
+uint8_t mcu_PowIn(void)
+{
+	mcu_Advance(PIN_IN_CYC);
+	return s_Power ? 1 : 0;
+}
+
+// RD16が有効なTMR1。TMR1Lを読んだ時点の上位バイトがラッチされ、TMR1Hではそれを読む。
+// TMR1LとTMR1Hの間に割込みが入ってTMR1Lを読むと、ラッチは上書きされる（本物と同じ）
+volatile uint8_t *sim_Tmr1L(void)
+{
+	mcu_Advance(TMR1L_CYC);
+	if (!s_InIsr)
+		s_Tmr1Reading = true;
+	else if (s_Tmr1Reading)
+		++s_Tmr1Corrupt;
+	const uint16_t v = (uint16_t)(g_SimNow / TMR1_TICK_CYC);
+	s_Tmr1L = (uint8_t)v;
+	s_Tmr1HLatch = (uint8_t)(v >> 8);
+	return &s_Tmr1L;
+}
+
+volatile uint8_t *sim_Tmr1H(void)
+{
+	mcu_Advance(TMR1H_CYC);
+	if (!s_InIsr)
+		s_Tmr1Reading = false;
+	return &s_Tmr1HLatch;
+}
+
+uint32_t mcu_Tmr1Corrupt(void)
+{
+	return s_Tmr1Corrupt;
+}
+
+void mcu_ProbeTxDone(const uint8_t dt)
+{
+	for (int t = 0; t < s_ObsNum; ++t) {
+		if (s_Obs[t]->onTxDone != NULL)
+			s_Obs[t]->onTxDone(dt);
+	}
+	return;
+}
+
+void mcu_ProbeRxDone(const uint8_t dt)
+{
+	for (int t = 0; t < s_ObsNum; ++t) {
+		if (s_Obs[t]->onRxDone != NULL)
+			s_Obs[t]->onRxDone(dt);
+	}
+	return;
+}
+
+void mcu_ProbeRxState(const int st)
+{
+	for (int t = 0; t < s_ObsNum; ++t) {
+		if (s_Obs[t]->onRxState != NULL)
+			s_Obs[t]->onRxState(st);
+	}
+	return;
+}
+
+void mcu_ProbeUsbRx(const volatile uint8_t *p, const uint8_t n)
+{
+	for (int t = 0; t < s_ObsNum; ++t) {
+		if (s_Obs[t]->onUsbRx != NULL)
+			s_Obs[t]->onUsbRx(p, n);
+	}
+	return;
+}
@@ -0,0 +1,71 @@
+#ifndef SIM_MCU_H
+#define SIM_MCU_H
+
+/*********************************************************************
+* PIC18F14K50 とPS/2ラインのシミュレーション
+*	時刻は命令サイクル（Fosc/4 = 12MHz、1サイクル = 83.3ns）で数える。
+*	ファームウェアがピンを読む、TMR1を読む、__delay_us() で待つと時刻が進み、その間に
+*	TMR2の一致、INT0（DATの立下り）の割込み、ラインの立ち上がり、ホストモデルの動作が起きる。
+*	割込みは、割込みが許可されていれば時刻が進むたびに（次の命令の前に）処理する。
+*
+*	ラインはオープンコレクタの論理積で、どちらかがLにすればすぐにLになり、両方がHにすると
+*	立ち上がり時間（mcu_SetRise()）の後にHになる。
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint64_t simtime_t;
+#define SIM_CYC_PER_US		12
+#define SIM_US(us)			((simtime_t)(us) * SIM_CYC_PER_US)
+#define SIM_MS(ms)			((simtime_t)(ms) * SIM_CYC_PER_US * 1000)
+#define SIM_NEVER			UINT64_MAX
+
+enum SIM_LINE { SIM_CLK, SIM_DAT, SIM_LINE_NUM };
+
+extern simtime_t g_SimNow;
+
+// ラインを観測するもの（ホストモデル、波形の記録など）。使わない関数は NULL でよい
+struct SIM_OBSERVER
+{
+	void (*onLine)(enum SIM_LINE line, int level);		// ラインのレベルが変わった
+	void (*onOut)(enum SIM_LINE line, bool bHost, int level);	// デバイスまたはホストの出力が変わった。0:Lにする、1:離す
+	void (*onTxDone)(uint8_t dt);						// PS2_PROBE_TX_DONE
+	void (*onRxDone)(uint8_t dt);						// PS2_PROBE_RX_DONE
+	void (*onUsbRx)(const volatile uint8_t *p, uint8_t n);	// PS2_PROBE_USB_RX
+	void (*onRxState)(int st);							// PS2_PROBE_RX_STATE
+};
+void mcu_AddObserver(const struct SIM_OBSERVER *p);
+
+// ラインを動かすもの（ホストモデル、ファジングのグリッチ）。時刻 nextEvent() になったら onTime() を呼ぶ
+struct SIM_PEER
+{
+	simtime_t (*nextEvent)(void);
+	void (*onTime)(void);
+};
+void mcu_AddPeer(const struct SIM_PEER *p);
+
+void mcu_Reset(void);
+void mcu_SetRise(simtime_t clkCyc, simtime_t datCyc);
+simtime_t mcu_Rise(enum SIM_LINE line);
+void mcu_SetPower(bool on);
+
+// 現在の文脈（メインループまたは割込み）で時間を進める
+void mcu_Advance(simtime_t cyc);
+void mcu_AdvanceTo(simtime_t t);
+
+int mcu_Level(enum SIM_LINE line);
+void mcu_HostOut(enum SIM_LINE line, int level);	// ホスト側の出力。0:Lにする、1:離す
+// ファームウェア側（sim_port.h から使う）
+void mcu_DevOut(enum SIM_LINE line, int lat);		// LAT の値。1:Lにする（トランジスタで反転される）
+uint8_t mcu_DevIn(enum SIM_LINE line);
+uint8_t mcu_PowIn(void);
+// メインループが TMR1L と TMR1H を読む間に、割込みが TMR1L を読んで上位バイトのラッチを上書きした回数
+uint32_t mcu_Tmr1Corrupt(void);
+
+void mcu_ProbeTxDone(uint8_t dt);
+void mcu_ProbeRxDone(uint8_t dt);
+void mcu_ProbeUsbRx(const volatile uint8_t *p, uint8_t n);
+void mcu_ProbeRxState(int st);
+
+#endif
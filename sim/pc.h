@@ -0,0 +1,37 @@
+#ifndef SIM_PC_H
+#define SIM_PC_H
+
+/*********************************************************************
+* USB CDC の偽物と、その先のPC（Winps2vkbd）
+*	USBDeviceTasks()、CDCTxService()、CDCRxGetPacket() などを、実際のUSBスタックの代わりに提供する。
+*	USBの転送は1msのフレーム単位とし、INのメッセージは CDCTxService() が渡した次のフレームでPCに届く。
+*	OUTのパケットは、エンドポイントが空いてから OUT_TURNAROUND 後に受け取れる。
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcu.h"
+
+#define PC_MSG_MAX		64
+
+struct PC_MSG
+{
+	simtime_t t;		// PCに届いた時刻（INのメッセージ）、送った時刻（OUTのパケット）
+	uint8_t len;
+	uint8_t dt[PC_MSG_MAX];
+};
+
+void pc_Reset(void);
+// OUTのパケットをPCから送る（送信待ちの列に入れる）
+void pc_Send(const uint8_t *p, uint8_t len);
+int pc_OutPending(void);		// まだファームウェアが受け取っていないパケットの数
+// PCが送ったOUTのパケット（pc_Send() を呼んだ順）
+int pc_OutNum(void);
+const struct PC_MSG *pc_Out(int idx);
+// PCに届いたINのメッセージ
+int pc_InNum(void);
+const struct PC_MSG *pc_In(int idx);
+// putUSBUSART() が、前のメッセージを送り終えていないために捨てたメッセージの数
+uint32_t pc_InLost(void);
+
+#endif
@@ -0,0 +1,191 @@
+/*********************************************************************
+* ps2sim --rec の2つの記録（reclog.h）を比べる
+*	ファームウェアを変える前と後で、同じ入力を ps2sim replay で与えた記録を比べるのに使う。
+*
+*	使い方: ps2diff [--max-shift us] 前の記録 後の記録
+*		・ホストが受け取ったバイト（RECT_DEVBYTE）の並びが最初に違うところと、その前後
+*		・並びが同じところで、バイトを受け取った時刻のずれ（後 - 前）の絶対値の p50、p99、最大
+*		・PCに届いたINのメッセージの順が同じか
+*		・それぞれの記録の、ホストのコマンドの往復時間（送信要求から次のバイトを受け取るまで）
+*	バイトの並びとINのメッセージの順が同じで、時刻のずれが --max-shift 以下なら 0、違えば 1、
+*	記録が読めなければ 2 で終わる。
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reclog.h"
+
+#define CONTEXT		4		// 違うところの前後に表示するレコードの数
+
+// type のレコードの番号を idx に集める
+static int collect(const struct RECLOG *log, const uint8_t type, int **pIdx)
+{
+	int *idx = malloc(sizeof(*idx) * (size_t)(log->num + 1));
+	if (idx == NULL)
+		abort();
+	int n = 0;
+	for (int i = 0; i < log->num; ++i) {
+		if (log->rec[i].type == type)
+			idx[n++] = i;
+	}
+	*pIdx = idx;
+	return n;
+}
+
+static bool sameRecord(const struct RECORD *a, const struct RECORD *b)
+{
+	return a->len == b->len && memcmp(a->dt, b->dt, a->len) == 0;
+}
+
+static int cmpTime(const void *a, const void *b)
+{
+	const simtime_t x = *(const simtime_t *)a;
+	const simtime_t y = *(const simtime_t *)b;
+	return (x < y) ? -1 : (y < x);
+}
+
+static void printLatency(const char *name, simtime_t *v, const int n)
+{
+	if (n == 0) {
+		printf("  %-8s n=    0\n", name);
+		return;
+	}
+	qsort(v, (size_t)n, sizeof(*v), cmpTime);
+	printf("  %-8s n=%5d  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name, n,
+		(double)v[(n - 1) * 50 / 100] / SIM_US(1), (double)v[(n - 1) * 99 / 100] / SIM_US(1),
+		(double)v[n - 1] / SIM_US(1));
+	return;
+}
+
+static void printContext(const char *name, const struct RECLOG *log, const int *idx, const int n, const int at)
+{
+	printf("  %s:\n", name);
+	for (int i = (CONTEXT < at) ? at - CONTEXT : 0; i < n && i <= at + CONTEXT; ++i) {
+		printf("  %s%6d ", (i == at) ? ">" : " ", i);
+		reclog_Print(stdout, &log->rec[idx[i]]);
+	}
+	if (n <= at)
+		printf("  >%6d (none)\n", at);
+	return;
+}
+
+// @return 最初に違うバイトの番号（同じなら -1）。同じところの時刻のずれの最大を *pMaxShift に
+static int diffDevBytes(const struct RECLOG *a, const struct RECLOG *b, simtime_t *pMaxShift)
+{
+	int *ia, *ib;
+	const int na = collect(a, RECT_DEVBYTE, &ia);
+	const int nb = collect(b, RECT_DEVBYTE, &ib);
+	int i = 0;
+	for (; i < na && i < nb && sameRecord(&a->rec[ia[i]], &b->rec[ib[i]]); ++i)
+		;
+	const int common = i;
+	const int diverge = (common < na || common < nb) ? common : -1;
+	printf("device bytes: %d / %d, ", na, nb);
+	if (diverge < 0)
+		printf("identical\n");
+	else {
+		printf("first difference at byte %d\n", diverge);
+		printContext("before", a, ia, na, diverge);
+		printContext("after", b, ib, nb, diverge);
+	}
+	simtime_t *shift = malloc(sizeof(*shift) * (size_t)(common + 1));
+	if (shift == NULL)
+		abort();
+	for (i = 0; i < common; ++i) {
+		const simtime_t ta = a->rec[ia[i]].t;
+		const simtime_t tb = b->rec[ib[i]].t;
+		shift[i] = (ta < tb) ? tb - ta : ta - tb;
+	}
+	printf("time shift of the common %d bytes:\n", common);
+	printLatency("|shift|", shift, common);
+	*pMaxShift = (common == 0) ? 0 : shift[common - 1];
+	free(shift);
+	free(ia);
+	free(ib);
+	return diverge;
+}
+
+// @return INのメッセージの順が同じか
+static bool diffInOrder(const struct RECLOG *a, const struct RECLOG *b)
+{
+	int *ia, *ib;
+	const int na = collect(a, RECT_IN, &ia);
+	const int nb = collect(b, RECT_IN, &ib);
+	int i = 0;
+	for (; i < na && i < nb && sameRecord(&a->rec[ia[i]], &b->rec[ib[i]]); ++i)
+		;
+	const bool same = (i == na && i == nb);
+	printf("IN messages: %d / %d, ", na, nb);
+	if (same)
+		printf("same order\n");
+	else {
+		printf("first difference at message %d\n", i);
+		printContext("before", a, ia, na, i);
+		printContext("after", b, ib, nb, i);
+	}
+	free(ia);
+	free(ib);
+	return same;
+}
+
+// ホストのコマンドの送信要求から、次にホストが受け取ったバイトまで
+static void printRtt(const char *name, const struct RECLOG *log)
+{
+	simtime_t *rtt = malloc(sizeof(*rtt) * (size_t)(log->num + 1));
+	if (rtt == NULL)
+		abort();
+	int n = 0;
+	for (int i = 0; i < log->num; ++i) {
+		if (log->rec[i].type != RECT_HOSTCMD)
+			continue;
+		for (int j = i + 1; j < log->num; ++j) {
+			if (log->rec[j].type == RECT_DEVBYTE) {
+				rtt[n++] = log->rec[j].t - log->rec[i].t;
+				break;
+			}
+		}
+	}
+	printLatency(name, rtt, n);
+	free(rtt);
+	return;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: ps2diff [--max-shift us] before.ps2l after.ps2l\n");
+	return 2;
+}
+
+int main(int argc, char *argv[])
+{
+	int arg = 1;
+	double maxShiftUs = -1;
+	if (arg + 1 < argc && strcmp(argv[arg], "--max-shift") == 0) {
+		maxShiftUs = atof(argv[arg + 1]);
+		arg += 2;
+	}
+	if (argc != arg + 2)
+		return usage();
+	struct RECLOG a, b;
+	if (!reclog_Load(&a, argv[arg]))
+		return 2;
+	if (!reclog_Load(&b, argv[arg + 1])) {
+		reclog_Free(&a);
+		return 2;
+	}
+	if (a.model != b.model || a.clkRise != b.clkRise || a.datRise != b.datRise)
+		printf("note: host model or rise time differs (%d, %d, %d / %d, %d, %d)\n",
+			a.model, a.clkRise, a.datRise, b.model, b.clkRise, b.datRise);
+	simtime_t maxShift;
+	const bool sameBytes = diffDevBytes(&a, &b, &maxShift) < 0;
+	const bool sameIn = diffInOrder(&a, &b);
+	printf("host command round trip:\n");
+	printRtt("before", &a);
+	printRtt("after", &b);
+	const bool shiftOk = maxShiftUs < 0 || (double)maxShift / SIM_US(1) <= maxShiftUs;
+	if (!shiftOk)
+		printf("time shift %.1f us exceeds --max-shift %.1f us\n", (double)maxShift / SIM_US(1), maxShiftUs);
+	reclog_Free(&a);
+	reclog_Free(&b);
+	return (sameBytes && sameIn && shiftOk) ? 0 : 1;
+}
@@ -0,0 +1,1044 @@
+/*********************************************************************
+* PS2VKBD のファームウェアをホストPC上で動かすシミュレータ
+*	app.c、main.c、mcc_generated_files をそのままビルドし、仮想PS/2ホスト（host.c）と
+*	偽のUSB CDC（cdc_fake.c）につないで動かす。
+*
+*	使い方: ps2sim [--vcd ファイル] [--rec ファイル] [--host ホスト] [--strict] [シナリオ]
+*		--vcd	: ラインの波形を VCD で記録する（vcd.h）
+*		--rec	: CDCのセッションとPS/2の送受信を記録する（reclog.h。最後に起動してからの分）
+*		--host	: 仮想PS/2ホストの動作（generic、ocm-3.8.2、ocm-3.9.x、de0-deocm。host.h）。既定は generic
+*		smoke	: ホストのコマンドへの応答と、PCから送ったスキャンコードが届くことを確かめる（既定）
+*		typematic : セット1、3でのキーリピート（'S'で送ったキーを押している間だけリピートする）
+*		usbin	: 返信、ホストのコマンドの通知、クレジットが重なっても、PCへのメッセージを捨てないことを確かめる
+*		echo	: ホストから ECHO（EE）を不規則な間隔で何度も送り、すべてに応答することを確かめる
+*		bench	: PCから送ったキーが、USBで受け取ってからPS/2で送り終えるまでの時間を測る
+*				  （1バイトごとと、パケットのシーケンス全体の p50、p99、最大）
+*		hosts	: すべてのホスト（--host を指定したときはそのホスト）について、キー入力とホストの
+*				  コマンドを不規則に重ねて、コマンドの往復時間（送信要求から応答まで）と、
+*				  届かなかったキーの割合を測る
+*		stress [KB] : PCから 'S' でスキャンコードを KB（既定 1024）だけ送り続け、PS/2へ送れたバイト数（毎秒）と
+*				  捨てたバイト数を、クレジットを使わないときと使うときについて測る
+*		replay ファイル : --rec の記録の入力（PCが送ったパケット、ホストのコマンド）を同じ時刻に与えて動かす。
+*				  ホストモデルと立ち上がり時間も記録のものを使う。--strict のときは出力もすべて
+*				  同じ時刻に同じになることを確かめる（違いは ps2diff で見る）
+*	成功したら 0、失敗したら 1 で終わる。
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcu.h"
+#include "sim.h"
+#include "host.h"
+#include "pc.h"
+#include "vcd.h"
+#include "rec.h"
+
+static int s_Fail;
+static const char *s_VcdPath;
+static const char *s_RecPath;
+static bool s_bStrict;
+static const struct HOSTMODEL *s_HostModel = &HOSTMODEL_GENERIC;
+static bool s_bHostModelSet;
+
+#define CHECK(cond, ...)	do { if (!(cond)) { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); ++s_Fail; } } while (0)
+
+// sim_Start() の前まで
+static void powerOn(const struct HOSTMODEL *model)
+{
+	mcu_Reset();
+	pc_Reset();
+	if (s_VcdPath != NULL && !vcd_Open(s_VcdPath)) {
+		perror(s_VcdPath);
+		exit(2);
+	}
+	host_Init(model);
+	if (s_RecPath != NULL || s_bStrict)
+		rec_Start();
+	return;
+}
+
+static void boot(const struct HOSTMODEL *model)
+{
+	powerOn(model);
+	sim_Start();
+	sim_RunFor(SIM_MS(50));	// ラインの測定などが終わるまで
+	return;
+}
+
+static int s_WaitRx;
+static bool hostRxReached(void)
+{
+	return s_WaitRx <= host_RxNum();
+}
+
+// ホストが受け取ったバイトのうち、idx 番目以降のエラーのないもの n 個を取り出す
+static int hostRxBytes(int idx, uint8_t *p, const int n)
+{
+	int cnt = 0;
+	for (; idx < host_LogNum() && cnt < n; ++idx) {
+		const struct HOSTBYTE *b = host_Log(idx);
+		if (b->dir == HOSTDIR_RX && b->err == HOSTERR_NONE)
+			p[cnt++] = b->dt;
+	}
+	return cnt;
+}
+
+// ホストから、今から delay 後に dt を送り、expect の n バイトが返るのを待つ。
+// @return 送信要求から最後のバイトまでの時間
+static simtime_t hostCmdAfter(const uint8_t dt, const simtime_t delay, const uint8_t *expect, const int n)
+{
+	const int idx = host_LogNum();
+	const simtime_t start = g_SimNow + delay;
+	host_SendAt(dt, start);
+	s_WaitRx = host_RxNum() + n;
+	const bool ok = sim_RunUntil(hostRxReached, SIM_MS(50));
+	uint8_t got[16];
+	const int cnt = hostRxBytes(idx, got, n);
+	CHECK(ok && cnt == n && memcmp(got, expect, (size_t)n) == 0, "host command %02X: expected %d bytes, got %d", dt, n, cnt);
+	return (cnt == 0) ? 0 : host_Log(host_LogNum() - 1)->t - start;
+}
+
+static simtime_t hostCmd(const uint8_t dt, const uint8_t *expect, const int n)
+{
+	return hostCmdAfter(dt, 0, expect, n);
+}
+
+// idx 番目以降の記録のエラーを調べる（起動時のラインの測定もホストには何も見えないこと）
+static void checkHostErrors(int idx)
+{
+	CHECK(mcu_Tmr1Corrupt() == 0, "TMR1 read corrupted by an interrupt %u times", mcu_Tmr1Corrupt());
+	for (; idx < host_LogNum(); ++idx) {
+		const struct HOSTBYTE *b = host_Log(idx);
+		CHECK(b->err == HOSTERR_NONE, "host %s %02X at %.1f us: error %d",
+			(b->dir == HOSTDIR_RX) ? "RX" : "TX", b->dt, (double)b->t / SIM_US(1), b->err);
+	}
+	return;
+}
+
+// PCに届いたメッセージの中に p があるか
+static bool pcReceived(const uint8_t *p, const uint8_t len)
+{
+	for (int t = 0; t < pc_InNum(); ++t) {
+		const struct PC_MSG *m = pc_In(t);
+		if (m->len == len && memcmp(m->dt, p, len) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool pcOutDone(void)
+{
+	return pc_OutPending() == 0;
+}
+
+static void pcSendWait(const uint8_t *p, const uint8_t len)
+{
+	pc_Send(p, len);
+	sim_RunUntil(pcOutDone, SIM_MS(10));
+	return;
+}
+
+static bool hostAllSent(void)
+{
+	return pcOutDone() && s_WaitRx <= host_RxNum();
+}
+
+// PCから p を送り、ホストが expect の n バイトを（余計なバイトなしに）受け取ることを確かめる
+static void pcSendExpect(const char *name, const uint8_t *p, const uint8_t len, const uint8_t *expect, const int n)
+{
+	const int idx = host_LogNum();
+	pc_Send(p, len);
+	s_WaitRx = host_RxNum() + n;
+	sim_RunUntil(hostAllSent, SIM_MS(100));
+	sim_RunFor(SIM_MS(5));
+	uint8_t got[32];
+	const int cnt = hostRxBytes(idx, got, sizeof(got));
+	CHECK(cnt == n && memcmp(got, expect, (size_t)n) == 0, "%s: expected %d bytes, got %d", name, n, cnt);
+	return;
+}
+
+static void scenarioSmoke(void)
+{
+	boot(s_HostModel);
+
+	static const uint8_t RESET_RESP[] = {0xFA, 0xAA};
+	hostCmd(0xFF, RESET_RESP, sizeof(RESET_RESP));
+	static const uint8_t ACK[] = {0xFA};
+	hostCmd(0xED, ACK, 1);
+	hostCmd(0x02, ACK, 1);
+	// 引数の前に RESEND を受け取っても、引数を待ったまま（FE の応答は最後に送った FA）
+	hostCmd(0xED, ACK, 1);
+	hostCmd(0xFE, ACK, 1);
+	hostCmd(0x02, ACK, 1);
+	static const uint8_t ID[] = {0xFA, 0xAB, 0x83};
+	hostCmd(0xF2, ID, sizeof(ID));
+	static const uint8_t ECHO[] = {0xEE};
+	hostCmd(0xEE, ECHO, 1);
+	// F0 00 は ACK と今のセットの番号（FF でセット2）
+	static const uint8_t SET_REPLY[] = {0xFA, 0x02};
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x00, SET_REPLY, sizeof(SET_REPLY));
+	hostCmd(0xF3, ACK, 1);
+	hostCmd(0x2B, ACK, 1);
+	for (int c = 0xF7; c <= 0xFA; ++c)
+		hostCmd((uint8_t)c, ACK, 1);
+	// FB〜FD の後は、次のコマンドまでキー番号が続き、それぞれに ACK
+	for (int c = 0xFB; c <= 0xFD; ++c) {
+		hostCmd((uint8_t)c, ACK, 1);
+		hostCmd(0x1C, ACK, 1);
+		hostCmd(0x32, ACK, 1);
+	}
+	// 知らないコマンド（キー番号の並びも終わる）には RESEND
+	static const uint8_t RESEND[] = {0xFE};
+	hostCmd(0xF1, RESEND, 1);
+	hostCmd(0x01, RESEND, 1);
+
+	// F5 の間は 'S' のスキャンコードを捨て、F4、F6 で送るようになる
+	static const uint8_t PKT_A[] = {'S', 0x1C, 0xF0, 0x1C};
+	hostCmd(0xF5, ACK, 1);
+	int idx = host_LogNum();
+	pcSendWait(PKT_A, sizeof(PKT_A));
+	sim_RunFor(SIM_MS(20));
+	uint8_t got[16];
+	int cnt = hostRxBytes(idx, got, sizeof(got));
+	CHECK(cnt == 0, "disabled: host got %d bytes", cnt);
+	hostCmd(0xF4, ACK, 1);
+	idx = host_LogNum();
+	pcSendWait(PKT_A, sizeof(PKT_A));
+	sim_RunFor(SIM_MS(20));
+	cnt = hostRxBytes(idx, got, sizeof(got));
+	CHECK(cnt == 3 && memcmp(got, &PKT_A[1], 3) == 0, "enabled by F4: host got %d bytes", cnt);
+	hostCmd(0xF5, ACK, 1);
+	hostCmd(0xF6, ACK, 1);	// 以下の 'S'、'K' で、F6 で送るようになったことを確かめる
+	sim_RunFor(SIM_MS(10));
+	static const uint8_t NOTIFY_RESET[] = {1, 0xFF};
+	static const uint8_t NOTIFY_LED[] = {2, 0xED, 0x02};
+	CHECK(pcReceived(NOTIFY_RESET, sizeof(NOTIFY_RESET)), "PC did not get the FF notification");
+	CHECK(pcReceived(NOTIFY_LED, sizeof(NOTIFY_LED)), "PC did not get the ED 02 notification");
+
+	// 'S'（A を押して離す、右Ctrl を押して離す）と 'K'（Esc を押して離す）
+	static const uint8_t PKT_S[] = {'S', 0x1C, 0xF0, 0x1C, 0xE0, 0x14, 0xE0, 0xF0, 0x14};
+	static const uint8_t PKT_K[] = {'K', 0, 0x80};
+	static const uint8_t EXPECT[] = {0x1C, 0xF0, 0x1C, 0xE0, 0x14, 0xE0, 0xF0, 0x14, 0x76, 0xF0, 0x76};
+	idx = host_LogNum();
+	pc_Send(PKT_S, sizeof(PKT_S));
+	pc_Send(PKT_K, sizeof(PKT_K));
+	s_WaitRx = host_RxNum() + (int)sizeof(EXPECT);
+	sim_RunUntil(hostAllSent, SIM_MS(100));
+	cnt = hostRxBytes(idx, got, sizeof(EXPECT));
+	CHECK(cnt == (int)sizeof(EXPECT) && memcmp(got, EXPECT, sizeof(EXPECT)) == 0, "scan codes: expected %zu bytes, got %d", sizeof(EXPECT), cnt);
+	// RESEND は最後に送り終えたバイト（キー入力でも）を返す
+	static const uint8_t LAST_KEY[] = {0x76};
+	hostCmd(0xFE, LAST_KEY, 1);
+
+	// PrintScreen は偽の Shift を前後に付け、Pause は押したときに全体を送る（離したときは何も送らない）。
+	// 'S' の Pause も 'K' と同じく１つのレコード
+	static const uint8_t PKT_SPECIAL[] = {'K', 79, 0x80 | 79, 81, 0x80 | 81};
+	static const uint8_t SPECIAL2[] = {0xE0, 0x12, 0xE0, 0x7C, 0xE0, 0xF0, 0x7C, 0xE0, 0xF0, 0x12,
+		0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77};
+	pcSendExpect("set 2 PrintScreen, Pause", PKT_SPECIAL, sizeof(PKT_SPECIAL), SPECIAL2, sizeof(SPECIAL2));
+	static const uint8_t PKT_PAUSE_S[] = {'S', 0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77};
+	pcSendExpect("set 2 Pause by 'S'", PKT_PAUSE_S, sizeof(PKT_PAUSE_S), &PKT_PAUSE_S[1], sizeof(PKT_PAUSE_S) - 1);
+	// 'K' はホストが選んだセットのコードにする（Esc、PrintScreen、Pause を押して離す）
+	static const uint8_t PKT_KEYS[] = {'K', 0, 0x80, 79, 0x80 | 79, 81, 0x80 | 81};
+	static const uint8_t KEYS1[] = {0x01, 0x81, 0xE0, 0x2A, 0xE0, 0x37, 0xE0, 0xB7, 0xE0, 0xAA,
+		0xE1, 0x1D, 0x45, 0xE1, 0x9D, 0xC5};
+	static const uint8_t KEYS3[] = {0x08, 0xF0, 0x08, 0x57, 0xF0, 0x57, 0x62, 0xF0, 0x62};
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x01, ACK, 1);
+	pcSendExpect("set 1 keys", PKT_KEYS, sizeof(PKT_KEYS), KEYS1, sizeof(KEYS1));
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x03, ACK, 1);
+	pcSendExpect("set 3 keys", PKT_KEYS, sizeof(PKT_KEYS), KEYS3, sizeof(KEYS3));
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x02, ACK, 1);
+
+	// ラインの立ち上がり時間（3us）から決めた待ち時間。'R'の返信 [2]CLKの周期、[3]待ち時間
+	static const uint8_t PKT_R[] = {'R'};
+	pc_Send(PKT_R, sizeof(PKT_R));
+	sim_RunUntil(pcOutDone, SIM_MS(10));
+	sim_RunFor(SIM_MS(5));
+	const struct PC_MSG *r = NULL;
+	for (int t = 0; t < pc_InNum(); ++t) {
+		if (pc_In(t)->len == 4 && pc_In(t)->dt[1] == 'R')
+			r = pc_In(t);
+	}
+	CHECK(r != NULL && 3 * 2 < r->dt[3] && r->dt[3] < 20, "line settle: %d us", (r == NULL) ? -1 : r->dt[3]);
+
+	checkHostErrors(0);
+	CHECK(pc_InLost() == 0, "IN messages lost: %u", pc_InLost());
+	printf("smoke: %s (%.1f ms simulated, %llu loops)\n", s_Fail ? "FAIL" : "ok",
+		(double)g_SimNow / SIM_MS(1), (unsigned long long)g_SimLoops);
+	return;
+}
+
+static uint32_t s_Rand = 1;
+// 0〜n-1 の乱数。返すのは16ビットなので、n は 65536 まで（時刻はサイクルではなく us で引くこと）
+static uint32_t simRand(const uint32_t n)
+{
+	s_Rand = s_Rand * 1103515245 + 12345;
+	return (s_Rand >> 16) % n;
+}
+
+// idx 番目以降にホストが受け取ったバイトのうち、dt でないものの数と、dt の数
+static void countHostRx(int idx, const uint8_t dt, int *pOther, int *pMatch)
+{
+	*pOther = *pMatch = 0;
+	for (; idx < host_LogNum(); ++idx) {
+		const struct HOSTBYTE *b = host_Log(idx);
+		if (b->dir != HOSTDIR_RX)
+			continue;
+		if (b->dt == dt)
+			++*pMatch;
+		else
+			++*pOther;
+	}
+	return;
+}
+
+static void scenarioTypematic(void)
+{
+	boot(s_HostModel);
+	static const uint8_t PKT_T[] = {'T', 1};
+	pcSendWait(PKT_T, sizeof(PKT_T));
+	static const uint8_t ACK[] = {0xFA};
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x01, ACK, 1);
+
+	// セット1: 1E（A）を押すとリピートし、9E で離すと止まる
+	static const uint8_t PKT_MAKE1[] = {'S', 0x1E};
+	static const uint8_t PKT_BREAK1[] = {'S', 0x9E};
+	int idx = host_LogNum();
+	pcSendWait(PKT_MAKE1, sizeof(PKT_MAKE1));
+	sim_RunFor(SIM_MS(700));
+	int other, match;
+	countHostRx(idx, 0x1E, &other, &match);
+	CHECK(other == 0 && 3 <= match, "set 1 repeat: %d x 1E, %d other", match, other);
+	pcSendWait(PKT_BREAK1, sizeof(PKT_BREAK1));
+	sim_RunFor(SIM_MS(20));
+	idx = host_LogNum();
+	sim_RunFor(SIM_MS(1000));
+	countHostRx(idx, 0x1E, &other, &match);
+	CHECK(other == 0 && match == 0, "set 1 release: %d x 1E, %d other after 9E", match, other);
+
+	// セット2の途中（E0 だけ）でセット3に切り替えても、E0 をセット3のキーに付けない（送信もリピートも）
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x02, ACK, 1);
+	static const uint8_t PKT_PREFIX[] = {'S', 0xE0};
+	pcSendWait(PKT_PREFIX, sizeof(PKT_PREFIX));
+	hostCmd(0xF0, ACK, 1);
+	hostCmd(0x03, ACK, 1);
+	static const uint8_t PKT_MAKE3[] = {'S', 0x1C};
+	idx = host_LogNum();
+	pcSendWait(PKT_MAKE3, sizeof(PKT_MAKE3));
+	sim_RunFor(SIM_MS(400));
+	uint8_t first = 0;
+	CHECK(hostRxBytes(idx, &first, 1) == 1 && first == 0x1C, "set 3 make: first byte %02X", first);
+	idx = host_LogNum();
+	sim_RunFor(SIM_MS(500));
+	countHostRx(idx, 0x1C, &other, &match);
+	CHECK(other == 0 && 3 <= match, "set 3 repeat: %d x 1C, %d other", match, other);
+
+	checkHostErrors(0);
+	printf("typematic: %s (%.1f ms simulated)\n", s_Fail ? "FAIL" : "ok", (double)g_SimNow / SIM_MS(1));
+	return;
+}
+
+// PCに届いたメッセージのうち、[1] が kind のものの数
+static int pcCount(const uint8_t kind)
+{
+	int n = 0;
+	for (int t = 0; t < pc_InNum(); ++t) {
+		if (2 <= pc_In(t)->len && pc_In(t)->dt[1] == kind)
+			++n;
+	}
+	return n;
+}
+
+static void scenarioUsbIn(void)
+{
+	boot(s_HostModel);
+	static const uint8_t PKT_F[] = {'F', 1};
+	pc_Send(PKT_F, sizeof(PKT_F));
+	// 送信バッファをあふれさせ、まとめかけのスキャンコード（E0 の続き）も持たせる
+	uint8_t fill[64] = {'S'};
+	memset(&fill[1], 0x1C, sizeof(fill) - 1);
+	pc_Send(fill, sizeof(fill));
+	pc_Send(fill, sizeof(fill));
+	static const uint8_t PKT_PREFIX[] = {'S', 0xE0, 0xE0, 0xE0, 0xE0};
+	pc_Send(PKT_PREFIX, sizeof(PKT_PREFIX));
+	// 返信を続けて要求し、同時にホストのコマンドも届くようにする
+	static const uint8_t PKT_T[] = {'T'}, PKT_R[] = {'R'}, PKT_D[] = {'D'}, PKT_I[] = {'I'};
+	pc_Send(PKT_T, sizeof(PKT_T));
+	pc_Send(PKT_R, sizeof(PKT_R));
+	pc_Send(PKT_D, sizeof(PKT_D));
+	pc_Send(PKT_I, sizeof(PKT_I));
+	static const uint8_t ACK[] = {0xFA};
+	hostCmd(0xED, ACK, 1);
+	hostCmd(0x02, ACK, 1);
+	sim_RunUntil(pcOutDone, SIM_MS(100));
+	sim_RunFor(SIM_MS(20));
+
+	CHECK(pc_InLost() == 0, "IN messages lost: %u", pc_InLost());
+	CHECK(pcCount('T') == 1 && pcCount('R') == 1 && pcCount('D') == 1 && pcCount('P') == 1,
+		"replies: T %d, R %d, D %d, I %d", pcCount('T'), pcCount('R'), pcCount('D'), pcCount('P'));
+	static const uint8_t NOTIFY_LED[] = {2, 0xED, 0x02};
+	CHECK(pcReceived(NOTIFY_LED, sizeof(NOTIFY_LED)), "PC did not get the ED 02 notification");
+	CHECK(0 < pcCount('F'), "no credit report");
+	for (int t = 0; t < pc_InNum(); ++t) {
+		const struct PC_MSG *m = pc_In(t);
+		if (m->len == 4 && m->dt[1] == 'F')
+			CHECK(m->dt[2] <= 64, "credit %d exceeds the buffer", m->dt[2]);
+	}
+	printf("usbin: %s (%d messages, %.1f ms simulated)\n", s_Fail ? "FAIL" : "ok", pc_InNum(),
+		(double)g_SimNow / SIM_MS(1));
+	return;
+}
+
+#define ECHO_NUM	5000
+
+static void scenarioEcho(void)
+{
+	boot(s_HostModel);
+	static const uint8_t ECHO[] = {0xEE};
+	for (int t = 0; t < ECHO_NUM; ++t) {
+		hostCmdAfter(0xEE, simRand(SIM_US(3000)), ECHO, 1);
+	}
+	checkHostErrors(0);
+	CHECK(pc_InLost() == 0, "IN messages lost: %u", pc_InLost());
+	printf("echo: %s (%d commands, %.1f ms simulated)\n", s_Fail ? "FAIL" : "ok", ECHO_NUM,
+		(double)g_SimNow / SIM_MS(1));
+	return;
+}
+
+/*********************************************************************
+* bench、hosts で送るキー
+*	よく使うキーと、E0 の付くキー（1/4）を乱数で選び、セット2の make（[E0] xx）と
+*	break（[E0] F0 xx）の 'S' パケットにする。
+*/
+struct KEYPKT
+{
+	uint8_t code;
+	bool bExt;
+	uint8_t make[3];
+	uint8_t makeLen;
+	uint8_t brk[4];
+	uint8_t brkLen;
+};
+
+static void randomKey(struct KEYPKT *k)
+{
+	static const uint8_t CODES[] = {0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33, 0x43, 0x3B};
+	static const uint8_t EXT_CODES[] = {0x14, 0x11, 0x75, 0x72, 0x6B, 0x74};
+	k->bExt = simRand(4) == 0;
+	k->code = k->bExt ? EXT_CODES[simRand(sizeof(EXT_CODES))] : CODES[simRand(sizeof(CODES))];
+	k->makeLen = k->brkLen = 0;
+	k->make[k->makeLen++] = 'S';
+	k->brk[k->brkLen++] = 'S';
+	if (k->bExt) {
+		k->make[k->makeLen++] = 0xE0;
+		k->brk[k->brkLen++] = 0xE0;
+	}
+	k->make[k->makeLen++] = k->code;
+	k->brk[k->brkLen++] = 0xF0;
+	k->brk[k->brkLen++] = k->code;
+	return;
+}
+
+/*********************************************************************
+* レイテンシの測定
+*	PS2_PROBE_USB_RX でパケットを受け取った時刻から、PS2_PROBE_TX_DONE（送信の割込みの中の
+*	終了ビットの終わり）までを、そのパケットの各バイトとシーケンス全体について測る。
+*/
+#define BENCH_PACKETS	1000
+
+static struct
+{
+	simtime_t rxAt[BENCH_PACKETS];	// USBで受け取った時刻
+	uint8_t len[BENCH_PACKETS];		// パケットのスキャンコードのバイト数
+	int rxNum;
+	int txPkt;						// 送信中のパケット
+	uint8_t txCnt;					// 送信中のパケットのうち送り終えたバイト数
+	simtime_t perByte[BENCH_PACKETS * 3];
+	int perByteNum;
+	simtime_t perSeq[BENCH_PACKETS];
+	int perSeqNum;
+} s_Bench;
+
+static void benchUsbRx(const volatile uint8_t *p, const uint8_t n)
+{
+	if (n < 2 || p[0] != 'S' || BENCH_PACKETS <= s_Bench.rxNum)
+		return;
+	s_Bench.rxAt[s_Bench.rxNum] = g_SimNow;
+	s_Bench.len[s_Bench.rxNum] = (uint8_t)(n - 1);
+	++s_Bench.rxNum;
+	return;
+}
+
+static void benchTxDone(const uint8_t dt)
+{
+	(void)dt;
+	if (s_Bench.rxNum <= s_Bench.txPkt)
+		return;
+	const simtime_t lat = g_SimNow - s_Bench.rxAt[s_Bench.txPkt];
+	s_Bench.perByte[s_Bench.perByteNum++] = lat;
+	if (++s_Bench.txCnt == s_Bench.len[s_Bench.txPkt]) {
+		s_Bench.perSeq[s_Bench.perSeqNum++] = lat;
+		++s_Bench.txPkt;
+		s_Bench.txCnt = 0;
+	}
+	return;
+}
+
+static const struct SIM_OBSERVER s_BenchObserver = { .onTxDone = benchTxDone, .onUsbRx = benchUsbRx };
+
+static int cmpTime(const void *a, const void *b)
+{
+	const simtime_t x = *(const simtime_t *)a;
+	const simtime_t y = *(const simtime_t *)b;
+	return (x < y) ? -1 : (y < x);
+}
+
+static void printLatency(const char *name, simtime_t *v, const int n)
+{
+	if (n == 0)
+		return;
+	qsort(v, (size_t)n, sizeof(*v), cmpTime);
+	printf("  %-8s n=%5d  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name, n,
+		(double)v[(n - 1) * 50 / 100] / SIM_US(1), (double)v[(n - 1) * 99 / 100] / SIM_US(1),
+		(double)v[n - 1] / SIM_US(1));
+	return;
+}
+
+static void scenarioBench(void)
+{
+	boot(s_HostModel);
+	s_Bench.rxNum = s_Bench.txPkt = s_Bench.perByteNum = s_Bench.perSeqNum = 0;
+	s_Bench.txCnt = 0;
+	mcu_AddObserver(&s_BenchObserver);
+
+	// キーを押して、1〜15ms後に離す。ときどき次のキーを続けて送る
+	int expectBytes = 0;
+	for (int t = 0; t < BENCH_PACKETS / 2; ++t) {
+		struct KEYPKT k;
+		randomKey(&k);
+		pc_Send(k.make, k.makeLen);
+		sim_RunFor(SIM_US(1000 + simRand(14000)));
+		pc_Send(k.brk, k.brkLen);
+		expectBytes += k.makeLen + k.brkLen - 2;
+		if (simRand(4) != 0)
+			sim_RunFor(SIM_US(simRand(20000)));
+	}
+	sim_RunUntil(pcOutDone, SIM_MS(1000));
+	sim_RunFor(SIM_MS(200));
+
+	checkHostErrors(0);
+	CHECK(s_Bench.perByteNum == expectBytes, "bench: expected %d bytes, sent %d", expectBytes, s_Bench.perByteNum);
+	printf("bench: %s (%d packets, %.1f ms simulated)\n", s_Fail ? "FAIL" : "ok", s_Bench.rxNum,
+		(double)g_SimNow / SIM_MS(1));
+	printLatency("byte", s_Bench.perByte, s_Bench.perByteNum);
+	printLatency("sequence", s_Bench.perSeq, s_Bench.perSeqNum);
+	return;
+}
+
+/*********************************************************************
+* ホストの動作ごとの往復時間と、届かなかったキー
+*	キー（randomKey()）は、ホストが受け取ったバイトからキーの
+*	イベントに戻して、送った順に照らし合わせる。送信禁止で中断したレコードは先頭から送りなおされる
+*	ので、E0、F0 が重なっても同じイベントとして数える。
+*	ホストごとに、CLKの周期が既定のときと、'R' でそのホストが受け取れる最短（HOSTMODEL.minClkUs）に
+*	したときの両方を確かめる。
+*/
+#define HOSTS_KEYS		300
+#define HOSTS_RTT_MAX	SIM_MS(20)		// PS/2の規格で、デバイスがコマンドに応答するまでの時間
+#define HOSTS_RESYNC	8				// 抜けたイベントを飛ばして探す数
+
+struct KEYEVENT
+{
+	uint8_t code;
+	bool bExt;
+	bool bBreak;
+};
+
+static bool keyEventEq(const struct KEYEVENT *a, const struct KEYEVENT *b)
+{
+	return a->code == b->code && a->bExt == b->bExt && a->bBreak == b->bBreak;
+}
+
+// idx 番目以降にホストが受け取ったバイトを、キーのイベントにして got に max 個まで入れる（EE の応答は除く）
+static int hostKeyEvents(int idx, struct KEYEVENT *got, const int max)
+{
+	int n = 0;
+	struct KEYEVENT cur = { 0, false, false };
+	for (; idx < host_LogNum() && n < max; ++idx) {
+		const struct HOSTBYTE *b = host_Log(idx);
+		if (b->dir != HOSTDIR_RX || b->err != HOSTERR_NONE || b->dt == 0xEE)
+			continue;
+		if (b->dt == 0xE0)
+			cur.bExt = true;
+		else if (b->dt == 0xF0)
+			cur.bBreak = true;
+		else {
+			cur.code = b->dt;
+			got[n++] = cur;
+			cur = (struct KEYEVENT){ 0, false, false };
+		}
+	}
+	return n;
+}
+
+// clkUs : 'R' で設定するCLKの周期（0:既定のまま）
+static void scenarioHostsOne(const struct HOSTMODEL *model, const uint8_t clkUs)
+{
+	static struct KEYEVENT expect[HOSTS_KEYS * 2], got[HOSTS_KEYS * 4];
+	static simtime_t rtt[HOSTS_KEYS];
+	int expectNum = 0, rttNum = 0;
+	const int failBefore = s_Fail;
+
+	boot(model);
+	uint8_t periodUs = 0;
+	const uint8_t PKT_R[] = {'R', clkUs};
+	pc_Send(PKT_R, (clkUs != 0) ? 2 : 1);
+	sim_RunUntil(pcOutDone, SIM_MS(10));
+	sim_RunFor(SIM_MS(5));
+	for (int t = 0; t < pc_InNum(); ++t) {
+		if (pc_In(t)->len == 4 && pc_In(t)->dt[1] == 'R')
+			periodUs = pc_In(t)->dt[2];
+	}
+	CHECK(clkUs == 0 || periodUs == clkUs, "%s: clock period %d us, requested %d us", model->name, periodUs, clkUs);
+	const int idx = host_LogNum();
+	for (int t = 0; t < HOSTS_KEYS; ++t) {
+		struct KEYPKT k;
+		randomKey(&k);
+		expect[expectNum++] = (struct KEYEVENT){ k.code, k.bExt, false };
+		expect[expectNum++] = (struct KEYEVENT){ k.code, k.bExt, true };
+		// ホストのコマンドは、キーの送信と関係のない時刻に出す
+		host_SendAt(0xEE, g_SimNow + SIM_US(simRand(20000)));
+		pc_Send(k.make, k.makeLen);
+		sim_RunFor(SIM_US(1000 + simRand(14000)));
+		pc_Send(k.brk, k.brkLen);
+		sim_RunFor(SIM_US(simRand(20000)));
+	}
+	sim_RunUntil(pcOutDone, SIM_MS(1000));
+	sim_RunFor(SIM_MS(200));
+
+	for (int i = idx; i < host_LogNum(); ++i) {
+		const struct HOSTBYTE *b = host_Log(i);
+		if (b->dir != HOSTDIR_TX || b->err != HOSTERR_NONE)
+			continue;
+		// 応答（EE）が届くまでの時間
+		for (int k = i + 1; k < host_LogNum(); ++k) {
+			const struct HOSTBYTE *r = host_Log(k);
+			if (r->dir == HOSTDIR_RX && r->err == HOSTERR_NONE && r->dt == 0xEE) {
+				rtt[rttNum++] = r->t - b->t;
+				break;
+			}
+		}
+	}
+	const int gotNum = hostKeyEvents(idx, got, HOSTS_KEYS * 4);
+	// 抜けたイベントがあっても、後ろのイベントをすべて予定外に数えないように、少し先まで探して合わせる
+	int next = 0, matched = 0, dup = 0, unexpected = 0;
+	for (int i = 0; i < gotNum; ++i) {
+		int k = next;
+		while (k < expectNum && k < next + HOSTS_RESYNC && !keyEventEq(&got[i], &expect[k]))
+			++k;
+		if (k < expectNum && k < next + HOSTS_RESYNC) {
+			++matched;
+			next = k + 1;
+		}
+		else if (0 < next && keyEventEq(&got[i], &expect[next - 1]))
+			++dup;
+		else
+			++unexpected;
+	}
+	const int dropped = expectNum - matched;
+
+	checkHostErrors(idx);
+	CHECK(rttNum == HOSTS_KEYS, "%s: %d of %d commands answered", model->name, rttNum, HOSTS_KEYS);
+	qsort(rtt, (size_t)rttNum, sizeof(*rtt), cmpTime);
+	CHECK(rttNum == 0 || rtt[rttNum - 1] <= HOSTS_RTT_MAX, "%s: round trip %.1f us", model->name,
+		(rttNum == 0) ? 0.0 : (double)rtt[rttNum - 1] / SIM_US(1));
+	CHECK(dropped == 0 && dup == 0 && unexpected == 0, "%s: %d of %d key events dropped, %d duplicated, %d unexpected",
+		model->name, dropped, expectNum, dup, unexpected);
+	CHECK(pc_InLost() == 0, "%s: IN messages lost: %u", model->name, pc_InLost());
+	printf("hosts: %-10s %3d us %s  drop %d/%d (%.2f%%), interrupted frames %u\n", model->name, periodUs,
+		(s_Fail == failBefore) ? "ok  " : "FAIL", dropped, expectNum, 100.0 * dropped / expectNum,
+		host_InterruptCount());
+	printLatency("rtt", rtt, rttNum);
+	return;
+}
+
+// 既定の周期と、ホストが受け取れる最短の周期で
+static void scenarioHostsModel(const struct HOSTMODEL *model)
+{
+	scenarioHostsOne(model, 0);
+	if (model->minClkUs != 0)
+		scenarioHostsOne(model, model->minClkUs);
+	return;
+}
+
+// --host を指定したときは、そのホストだけ
+static void scenarioHosts(void)
+{
+	if (s_bHostModelSet) {
+		scenarioHostsModel(s_HostModel);
+		return;
+	}
+	for (int i = 0; g_HostModels[i] != NULL; ++i)
+		scenarioHostsModel(g_HostModels[i]);
+	return;
+}
+
+/*********************************************************************
+* 'S' で大量のスキャンコードを送り続けたときの、PS/2へ送れたバイト数と捨てたバイト数
+*	flood	: 前のパケットをファームウェアが受け取ったらすぐに次を送る（送信バッファが満杯なら捨てられる）
+*	credit	: 'F' で通知される送信バッファの空き（クレジット）の分だけ送る（捨てられないはず）
+*	どちらも、ときどきホストから EE を送って、送信中のレコードを送りなおさせる。
+*	'D' の返信の、送信したバイト数と捨てたバイト数の和が送ったバイト数と同じで、送信したバイト数が
+*	ホストが受け取ったキーのバイト数と同じで、キーが送った順に並んでいる（捨てたレコードは抜ける）
+*	ことを確かめる。
+*/
+#define STRESS_KB_DEFAULT	1024
+#define STRESS_REC_MAX		3		// make、break のレコードの最大のバイト数
+#define STRESS_EE_INTERVAL_US	40000
+
+static struct
+{
+	uint32_t total;				// 送るバイト数
+	uint32_t sent;				// 'S' で送ったバイト数
+	struct KEYEVENT *expect;	// 送ったレコード
+	int expectNum;
+	struct KEYPKT key;
+	bool bBreak;				// 次は key の break
+	simtime_t eeAt;				// 次にホストから EE を送る時刻
+	// クレジット
+	uint8_t free;				// 最後に通知された空き
+	uint8_t rxCnt;				// そのときファームウェアが処理し終えていたパケット数
+	uint8_t pktCnt;				// 送ったパケット数
+	uint8_t pktLen[256];		// 送ったパケットのスキャンコードのバイト数（pktCnt の下位8ビットで引く）
+	int inIdx;					// 次に読むPCへのメッセージ
+} s_Stress;
+
+static uint8_t recordLen(const struct KEYEVENT *e)
+{
+	return (uint8_t)(1 + e->bExt + e->bBreak);
+}
+
+// 次のレコード（キーの make、break の順）を p に入れる。@return バイト数
+static uint8_t stressRecord(uint8_t *p)
+{
+	if (!s_Stress.bBreak)
+		randomKey(&s_Stress.key);
+	const struct KEYPKT *k = &s_Stress.key;
+	const uint8_t len = (uint8_t)((s_Stress.bBreak ? k->brkLen : k->makeLen) - 1);
+	memcpy(p, (s_Stress.bBreak ? k->brk : k->make) + 1, len);
+	s_Stress.expect[s_Stress.expectNum++] = (struct KEYEVENT){ k->code, k->bExt, s_Stress.bBreak };
+	s_Stress.bBreak = !s_Stress.bBreak;
+	return len;
+}
+
+// 'S' と、max バイトまでのレコードを送る。@return スキャンコードのバイト数
+static uint8_t stressSend(const uint8_t max)
+{
+	uint8_t pkt[PC_MSG_MAX] = {'S'};
+	uint8_t len = 1;
+	while (len - 1 + STRESS_REC_MAX <= max && s_Stress.sent + (uint32_t)(len - 1) < s_Stress.total)
+		len += stressRecord(&pkt[len]);
+	if (len == 1)
+		return 0;
+	pc_Send(pkt, len);
+	s_Stress.sent += len - 1u;
+	s_Stress.pktLen[s_Stress.pktCnt++] = (uint8_t)(len - 1);
+	return (uint8_t)(len - 1);
+}
+
+static void stressHostCmd(void)
+{
+	if (g_SimNow < s_Stress.eeAt)
+		return;
+	host_Send(0xEE);
+	s_Stress.eeAt = g_SimNow + SIM_US(simRand(STRESS_EE_INTERVAL_US));
+	return;
+}
+
+static bool pcInArrived(void)
+{
+	return s_Stress.inIdx < pc_InNum();
+}
+
+// 届いたクレジットの通知を読み、送ってよいバイト数を返す
+static int stressCredit(void)
+{
+	for (; s_Stress.inIdx < pc_InNum(); ++s_Stress.inIdx) {
+		const struct PC_MSG *m = pc_In(s_Stress.inIdx);
+		if (m->len == 4 && m->dt[1] == 'F') {
+			s_Stress.free = m->dt[2];
+			s_Stress.rxCnt = m->dt[3];
+		}
+	}
+	int avail = s_Stress.free;
+	for (uint8_t t = s_Stress.rxCnt; t != s_Stress.pktCnt; ++t)
+		avail -= s_Stress.pktLen[t];
+	return avail;
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void scenarioStressOne(const char *name, const bool bCredit, const uint32_t total)
+{
+	const int failBefore = s_Fail;
+	boot(s_HostModel);
+	const int idx = host_LogNum();
+	const simtime_t start = g_SimNow;
+	s_Stress.total = total;
+	s_Stress.sent = 0;
+	s_Stress.expect = realloc(s_Stress.expect, sizeof(*s_Stress.expect) * total);
+	s_Stress.expectNum = 0;
+	s_Stress.bBreak = false;
+	s_Stress.eeAt = g_SimNow + SIM_US(simRand(STRESS_EE_INTERVAL_US));
+	s_Stress.free = 0;
+	s_Stress.rxCnt = s_Stress.pktCnt = 0;
+	s_Stress.inIdx = pc_InNum();
+	if (s_Stress.expect == NULL)
+		abort();
+
+	if (bCredit) {
+		static const uint8_t PKT_F[] = {'F', 1};
+		pc_Send(PKT_F, sizeof(PKT_F));
+	}
+	while (s_Stress.sent < total) {
+		stressHostCmd();
+		if (!bCredit) {
+			stressSend(PC_MSG_MAX - 1);
+			sim_RunUntil(pcOutDone, SIM_MS(100));
+			continue;
+		}
+		const int avail = stressCredit();
+		if (avail < STRESS_REC_MAX || stressSend((uint8_t)((avail < PC_MSG_MAX - 1) ? avail : PC_MSG_MAX - 1)) == 0)
+			sim_RunUntil(pcInArrived, SIM_MS(10));
+		else
+			sim_RunUntil(pcOutDone, SIM_MS(100));
+	}
+	sim_RunUntil(pcOutDone, SIM_MS(100));
+	sim_RunFor(SIM_MS(200));	// 送信バッファ（64バイト）を送り終えるまで
+	// 送れた速さは、ホストが最後のバイトを受け取るまでで測る
+	simtime_t end = g_SimNow;
+	for (int t = host_LogNum() - 1; idx <= t; --t) {
+		if (host_Log(t)->dir == HOSTDIR_RX) {
+			end = host_Log(t)->t;
+			break;
+		}
+	}
+
+	static const uint8_t PKT_D[] = {'D'};
+	pc_Send(PKT_D, sizeof(PKT_D));
+	sim_RunUntil(pcOutDone, SIM_MS(10));
+	sim_RunFor(SIM_MS(5));
+	const struct PC_MSG *d = NULL;
+	for (int t = 0; t < pc_InNum(); ++t) {
+		if (pc_In(t)->len == 26 && pc_In(t)->dt[1] == 'D')
+			d = pc_In(t);
+	}
+	CHECK(d != NULL, "%s: no 'D' reply", name);
+	const uint32_t delivered = (d == NULL) ? 0 : getU32(&d->dt[2]);
+	const uint32_t dropped = (d == NULL) ? 0 : getU32(&d->dt[6]);
+	const uint32_t droppedS = (d == NULL) ? 0 : getU32(&d->dt[10]);
+	CHECK(delivered + dropped == s_Stress.sent, "%s: delivered %u + dropped %u != sent %u", name, delivered, dropped,
+		s_Stress.sent);
+	CHECK(dropped == droppedS, "%s: %u bytes dropped from other than 'S'", name, dropped - droppedS);
+	CHECK(!bCredit || dropped == 0, "%s: %u bytes dropped within the credit", name, dropped);
+
+	// ホストが受け取ったキーが、送ったレコードの順に並んでいるか
+	struct KEYEVENT *got = malloc(sizeof(*got) * total);
+	if (got == NULL)
+		abort();
+	const int gotNum = hostKeyEvents(idx, got, (int)total);
+	uint32_t gotBytes = 0;
+	int k = 0, i = 0;
+	for (; i < gotNum; ++i, ++k) {
+		while (k < s_Stress.expectNum && !keyEventEq(&got[i], &s_Stress.expect[k]))
+			++k;
+		if (k == s_Stress.expectNum)
+			break;
+		gotBytes += recordLen(&got[i]);
+	}
+	CHECK(i == gotNum, "%s: key %d received out of order", name, i);
+	CHECK(gotBytes == delivered, "%s: host got %u key bytes, 'D' says %u", name, gotBytes, delivered);
+	free(got);
+	checkHostErrors(idx);
+	CHECK(pc_InLost() == 0, "%s: IN messages lost: %u", name, pc_InLost());
+
+	const double sec = (double)(end - start) / SIM_MS(1000);
+	printf("stress: %-6s %s  sent %u, delivered %u (%.0f bytes/s), dropped %u (%.2f%%), %.1f s simulated\n", name,
+		(s_Fail == failBefore) ? "ok  " : "FAIL", s_Stress.sent, delivered, delivered / sec, dropped,
+		100.0 * dropped / s_Stress.sent, sec);
+	return;
+}
+
+// kb : 送るデータの量（KB）
+static void scenarioStress(const char *kb)
+{
+	const uint32_t total = (kb != NULL) ? (uint32_t)atoi(kb) * 1024 : STRESS_KB_DEFAULT * 1024;
+	scenarioStressOne("flood", false, total);
+	scenarioStressOne("credit", true, total);
+	free(s_Stress.expect);
+	s_Stress.expect = NULL;
+	return;
+}
+
+static struct RECLOG s_Replay;
+static int s_ReplayNext;		// 次に与える入力のレコード
+
+static void replaySkip(void)
+{
+	while (s_ReplayNext < s_Replay.num && !reclog_IsInput(s_Replay.rec[s_ReplayNext].type))
+		++s_ReplayNext;
+	return;
+}
+
+// 次の入力を与える時刻。OUTのパケットは記録の時刻に送る。
+// ホストのコマンドは1サイクル前に送信待ちの列に入れておき、記録の時刻に送信要求を出すようにする
+// （記録の時刻に入れると、ホストは mcu_AdvanceTo() が返った後に送り始めるので、ファームウェアから見た順が変わる）
+static simtime_t replayNextEvent(void)
+{
+	if (s_ReplayNext == s_Replay.num)
+		return SIM_NEVER;
+	const struct RECORD *r = &s_Replay.rec[s_ReplayNext];
+	return (r->type == RECT_HOSTCMD && 0 < r->t) ? r->t - 1 : r->t;
+}
+
+static void replayOnTime(void)
+{
+	for (; replayNextEvent() <= g_SimNow; ++s_ReplayNext, replaySkip()) {
+		const struct RECORD *r = &s_Replay.rec[s_ReplayNext];
+		if (r->type == RECT_OUT)
+			pc_Send(r->dt, r->len);
+		else
+			host_SendAt(r->dt[0], r->t);
+	}
+	return;
+}
+
+static const struct SIM_PEER s_ReplayPeer = { replayNextEvent, replayOnTime };
+
+// 入力、出力のどちらかが違う最初のレコードを表示する
+static void replayCompare(void)
+{
+	struct RECLOG got;
+	reclog_Init(&got);
+	rec_Collect(&got);
+	int i = 0;
+	for (; i < s_Replay.num && i < got.num; ++i) {
+		const struct RECORD *a = &s_Replay.rec[i];
+		const struct RECORD *b = &got.rec[i];
+		if (a->t != b->t || a->type != b->type || a->len != b->len || memcmp(a->dt, b->dt, a->len) != 0)
+			break;
+	}
+	if (i < s_Replay.num || i < got.num) {
+		fprintf(stderr, "replay: record %d differs\n  recorded:", i);
+		if (i < s_Replay.num)
+			reclog_Print(stderr, &s_Replay.rec[i]);
+		else
+			fputs(" (none)\n", stderr);
+		fputs("  replayed:", stderr);
+		if (i < got.num)
+			reclog_Print(stderr, &got.rec[i]);
+		else
+			fputs(" (none)\n", stderr);
+		++s_Fail;
+	}
+	else
+		printf("replay: %d records identical\n", got.num);
+	reclog_Free(&got);
+	return;
+}
+
+static void scenarioReplay(const char *path)
+{
+	if (!reclog_Load(&s_Replay, path)) {
+		++s_Fail;
+		return;
+	}
+	int models = 0;
+	while (g_HostModels[models] != NULL)
+		++models;
+	if (models <= s_Replay.model) {
+		fprintf(stderr, "%s: unknown host model %d\n", path, s_Replay.model);
+		++s_Fail;
+		return;
+	}
+	powerOn(g_HostModels[s_Replay.model]);
+	mcu_SetRise(s_Replay.clkRise, s_Replay.datRise);
+	s_ReplayNext = 0;
+	replaySkip();
+	mcu_AddPeer(&s_ReplayPeer);
+	sim_Start();
+	const simtime_t end = s_Replay.rec[s_Replay.num - 1].t;
+	if (g_SimNow < end)
+		sim_RunFor(end - g_SimNow);
+	printf("replay: %s, host %s, %.1f ms, %d bytes to host\n", path, g_HostModels[s_Replay.model]->name,
+		(double)end / SIM_MS(1), host_RxNum());
+	if (s_bStrict)
+		replayCompare();
+	return;
+}
+
+static int usage(void)
+{
+	fprintf(stderr, "usage: ps2sim [--vcd file] [--rec file] [--host model] [--strict]"
+		" [smoke|typematic|usbin|echo|bench|hosts|stress [KB]|replay file]\n");
+	return 2;
+}
+
+int main(int argc, char *argv[])
+{
+	int arg = 1;
+	for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; ++arg) {
+		if (strcmp(argv[arg], "--strict") == 0) {
+			s_bStrict = true;
+			continue;
+		}
+		if (argc <= arg + 1)
+			return usage();
+		if (strcmp(argv[arg], "--vcd") == 0)
+			s_VcdPath = argv[++arg];
+		else if (strcmp(argv[arg], "--rec") == 0)
+			s_RecPath = argv[++arg];
+		else if (strcmp(argv[arg], "--host") == 0) {
+			s_HostModel = host_FindModel(argv[++arg]);
+			if (s_HostModel == NULL)
+				return usage();
+			s_bHostModelSet = true;
+		}
+		else
+			return usage();
+	}
+	const char *scenario = (arg < argc) ? argv[arg] : "smoke";
+	if (strcmp(scenario, "smoke") == 0)
+		scenarioSmoke();
+	else if (strcmp(scenario, "typematic") == 0)
+		scenarioTypematic();
+	else if (strcmp(scenario, "usbin") == 0)
+		scenarioUsbIn();
+	else if (strcmp(scenario, "echo") == 0)
+		scenarioEcho();
+	else if (strcmp(scenario, "bench") == 0)
+		scenarioBench();
+	else if (strcmp(scenario, "hosts") == 0)
+		scenarioHosts();
+	else if (strcmp(scenario, "stress") == 0)
+		scenarioStress((arg + 1 < argc) ? argv[arg + 1] : NULL);
+	else if (strcmp(scenario, "replay") == 0 && arg + 1 < argc)
+		scenarioReplay(argv[arg + 1]);
+	else
+		return usage();
+	if (s_RecPath != NULL && !rec_Save(s_RecPath)) {
+		perror(s_RecPath);
+		return 2;
+	}
+	vcd_Close();
+	return s_Fail ? 1 : 0;
+}
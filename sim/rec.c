@@ -0,0 +1,95 @@
+/*********************************************************************
+* シミュレーションの記録（rec.h）
+*	ホストの出力とデバイスが受け取ったバイトは起きたときに記録し、ほかは rec_Collect() で
+*	PC（pc.h）とホスト（host.h）の記録から集めて、時刻の順に並べる。
+*/
+#include <string.h>
+#include "rec.h"
+#include "host.h"
+#include "pc.h"
+
+static struct RECLOG s_Live;
+
+static void onOut(const enum SIM_LINE line, const bool bHost, const int level)
+{
+	if (!bHost)
+		return;
+	struct RECORD *r = reclog_Add(&s_Live, g_SimNow, RECT_HOSTLINE);
+	r->dt[0] = (uint8_t)(line * 2 + (level ? 1 : 0));
+	r->len = 1;
+	return;
+}
+
+static void onRxDone(const uint8_t dt)
+{
+	struct RECORD *r = reclog_Add(&s_Live, g_SimNow, RECT_HOSTBYTE);
+	r->dt[0] = dt;
+	r->len = 1;
+	return;
+}
+
+static const struct SIM_OBSERVER s_Observer = { .onOut = onOut, .onRxDone = onRxDone };
+
+void rec_Start(void)
+{
+	s_Live.num = 0;
+	mcu_AddObserver(&s_Observer);
+	return;
+}
+
+static void addMsg(struct RECLOG *log, const uint8_t type, const struct PC_MSG *m)
+{
+	struct RECORD *r = reclog_Add(log, m->t, type);
+	r->len = m->len;
+	memcpy(r->dt, m->dt, m->len);
+	return;
+}
+
+void rec_Collect(struct RECLOG *log)
+{
+	reclog_Free(log);
+	const struct HOSTMODEL *model = host_Model();
+	for (int i = 0; g_HostModels[i] != NULL; ++i) {
+		if (g_HostModels[i] == model)
+			log->model = (uint8_t)i;
+	}
+	log->clkRise = (uint16_t)mcu_Rise(SIM_CLK);
+	log->datRise = (uint16_t)mcu_Rise(SIM_DAT);
+	// 入力を先に入れておくと、同じ時刻の出力より前に並ぶ
+	for (int i = 0; i < pc_OutNum(); ++i)
+		addMsg(log, RECT_OUT, pc_Out(i));
+	for (int i = 0; i < host_LogNum(); ++i) {
+		const struct HOSTBYTE *b = host_Log(i);
+		if (b->dir == HOSTDIR_TX) {
+			struct RECORD *r = reclog_Add(log, b->t, RECT_HOSTCMD);
+			r->dt[0] = b->dt;
+			r->len = 1;
+		}
+	}
+	for (int i = 0; i < s_Live.num; ++i)
+		*reclog_Add(log, 0, 0) = s_Live.rec[i];
+	for (int i = 0; i < host_LogNum(); ++i) {
+		const struct HOSTBYTE *b = host_Log(i);
+		if (b->dir == HOSTDIR_RX) {
+			struct RECORD *r = reclog_Add(log, b->t, RECT_DEVBYTE);
+			r->dt[0] = b->dt;
+			r->dt[1] = b->err;
+			r->len = 2;
+		}
+	}
+	for (int i = 0; i < pc_InNum(); ++i)
+		addMsg(log, RECT_IN, pc_In(i));
+	reclog_Sort(log);
+	reclog_Add(log, g_SimNow, RECT_END);
+	return;
+}
+
+bool rec_Save(const char *path)
+{
+	struct RECLOG log;
+	reclog_Init(&log);
+	rec_Collect(&log);
+	const bool ok = reclog_Save(&log, path);
+	reclog_Free(&log);
+	return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef SIM_REC_H
+#define SIM_REC_H
+
+/*********************************************************************
+* シミュレーションの記録（reclog.h の形式で残す）
+*	rec_Start() から、PCが送ったOUTのパケット、ホストのコマンド、PCに届いたINのメッセージ、
+*	ホストの出力、ホストとデバイスがそれぞれ受け取ったバイトを記録する。
+*/
+
+#include <stdbool.h>
+#include "reclog.h"
+
+// host_Init() の後に呼ぶ（それまでの記録は捨てる）
+void rec_Start(void);
+// ここまでの記録を log に入れる。最後の RECT_END は今の時刻
+void rec_Collect(struct RECLOG *log);
+// @return 書けたか
+bool rec_Save(const char *path);
+
+#endif
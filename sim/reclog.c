@@ -0,0 +1,187 @@
+/*********************************************************************
+* CDCのセッションとPS/2の送受信の記録（reclog.h）
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "reclog.h"
+#include "host.h"
+
+static const char MAGIC[4] = { 'P', 'S', '2', 'L' };
+
+void reclog_Init(struct RECLOG *log)
+{
+	memset(log, 0, sizeof(*log));
+	return;
+}
+
+void reclog_Free(struct RECLOG *log)
+{
+	free(log->rec);
+	reclog_Init(log);
+	return;
+}
+
+struct RECORD *reclog_Add(struct RECLOG *log, const simtime_t t, const uint8_t type)
+{
+	if (log->num == log->cap) {
+		log->cap = (log->cap == 0) ? 4096 : log->cap * 2;
+		log->rec = realloc(log->rec, sizeof(*log->rec) * (size_t)log->cap);
+		if (log->rec == NULL)
+			abort();
+	}
+	struct RECORD *r = &log->rec[log->num++];
+	r->t = t;
+	r->type = type;
+	r->len = 0;
+	return r;
+}
+
+// 挿入で並べる。記録はほとんど時刻の順に加えるので速く、同じ時刻のレコードの順も変わらない
+void reclog_Sort(struct RECLOG *log)
+{
+	for (int i = 1; i < log->num; ++i) {
+		const struct RECORD r = log->rec[i];
+		int j = i;
+		for (; 0 < j && r.t < log->rec[j - 1].t; --j)
+			log->rec[j] = log->rec[j - 1];
+		log->rec[j] = r;
+	}
+	return;
+}
+
+static void putLeb128(FILE *fp, uint64_t v)
+{
+	do {
+		uint8_t b = v & 0x7F;
+		v >>= 7;
+		if (v != 0)
+			b |= 0x80;
+		fputc(b, fp);
+	} while (v != 0);
+	return;
+}
+
+static bool getLeb128(FILE *fp, uint64_t *pV)
+{
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		const int c = fgetc(fp);
+		if (c == EOF)
+			return false;
+		v |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80)) {
+			*pV = v;
+			return true;
+		}
+	}
+	return false;
+}
+
+// 種類ごとの内容の長さ。0xFF は先頭の1バイトが長さ
+static uint8_t payloadLen(const uint8_t type)
+{
+	switch (type) {
+		case RECT_OUT:
+		case RECT_IN:
+			return 0xFF;
+		case RECT_HOSTCMD:
+		case RECT_HOSTLINE:
+		case RECT_HOSTBYTE:
+			return 1;
+		case RECT_DEVBYTE:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+bool reclog_Save(const struct RECLOG *log, const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL)
+		return false;
+	fwrite(MAGIC, 1, sizeof(MAGIC), fp);
+	const uint8_t head[6] = { RECLOG_VERSION, log->model, (uint8_t)log->clkRise, (uint8_t)(log->clkRise >> 8),
+		(uint8_t)log->datRise, (uint8_t)(log->datRise >> 8) };
+	fwrite(head, 1, sizeof(head), fp);
+	simtime_t last = 0;
+	for (int i = 0; i < log->num; ++i) {
+		const struct RECORD *r = &log->rec[i];
+		fputc(r->type, fp);
+		putLeb128(fp, r->t - last);
+		last = r->t;
+		if (payloadLen(r->type) == 0xFF)
+			fputc(r->len, fp);
+		fwrite(r->dt, 1, r->len, fp);
+	}
+	const bool ok = !ferror(fp);
+	return (fclose(fp) == 0) && ok;
+}
+
+bool reclog_Load(struct RECLOG *log, const char *path)
+{
+	reclog_Init(log);
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) {
+		perror(path);
+		return false;
+	}
+	char magic[sizeof(MAGIC)];
+	uint8_t head[6];
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+		|| fread(head, 1, sizeof(head), fp) != sizeof(head) || head[0] != RECLOG_VERSION) {
+		fprintf(stderr, "%s: not a version %d PS2L log\n", path, RECLOG_VERSION);
+		fclose(fp);
+		return false;
+	}
+	log->model = head[1];
+	log->clkRise = (uint16_t)(head[2] | head[3] << 8);
+	log->datRise = (uint16_t)(head[4] | head[5] << 8);
+	simtime_t t = 0;
+	for (;;) {
+		const int type = fgetc(fp);
+		uint64_t delta;
+		if (type == EOF || RECT_NUM <= type || !getLeb128(fp, &delta))
+			break;
+		t += delta;
+		struct RECORD *r = reclog_Add(log, t, (uint8_t)type);
+		r->len = payloadLen(r->type);
+		if (r->len == 0xFF) {
+			const int len = fgetc(fp);
+			if (len == EOF || RECLOG_DATA_MAX < len)
+				break;
+			r->len = (uint8_t)len;
+		}
+		if (fread(r->dt, 1, r->len, fp) != r->len)
+			break;
+		if (r->type == RECT_END) {
+			fclose(fp);
+			return true;
+		}
+	}
+	fprintf(stderr, "%s: broken record %d\n", path, log->num);
+	fclose(fp);
+	reclog_Free(log);
+	return false;
+}
+
+bool reclog_IsInput(const uint8_t type)
+{
+	return type == RECT_OUT || type == RECT_HOSTCMD;
+}
+
+void reclog_Print(FILE *fp, const struct RECORD *r)
+{
+	static const char *const NAME[RECT_NUM] = { "end", "out", "hostcmd", "in", "hostline", "devbyte", "hostbyte" };
+	fprintf(fp, "%12.1f us  %-8s", (double)r->t / SIM_US(1), NAME[r->type]);
+	if (r->type == RECT_HOSTLINE)
+		fprintf(fp, " %s=%d", (r->dt[0] >> 1) == SIM_CLK ? "clk" : "dat", r->dt[0] & 1);
+	else if (r->type == RECT_DEVBYTE)
+		fprintf(fp, (r->dt[1] != HOSTERR_NONE) ? " %02X error %d" : " %02X", r->dt[0], r->dt[1]);
+	else {
+		for (int i = 0; i < r->len; ++i)
+			fprintf(fp, " %02X", r->dt[i]);
+	}
+	fputc('\n', fp);
+	return;
+}
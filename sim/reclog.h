@@ -0,0 +1,65 @@
+#ifndef SIM_RECLOG_H
+#define SIM_RECLOG_H
+
+/*********************************************************************
+* CDCのセッションとPS/2の送受信の記録（ps2sim --rec が書き、ps2sim replay、ps2diff が読む）
+*	ファイルの形式。整数はリトルエンディアン、時刻は命令サイクル（mcu.h、12サイクル = 1us）
+*		ヘッダ	: "PS2L"、版（RECLOG_VERSION）、ホストモデルの番号（host.h の g_HostModels）、
+*				  CLKとDATの立ち上がり時間（uint16_t、サイクル）
+*		レコード	: 種類（RECT_*）、前のレコードからの時間（LEB128）、種類ごとの内容
+*	最後のレコードは RECT_END。
+*	入力（RECT_OUT、RECT_HOSTCMD）を同じ時刻に与えれば、同じファームウェアは同じ出力を同じ時刻に返す。
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcu.h"
+
+#define RECLOG_VERSION		1
+#define RECLOG_DATA_MAX		64
+
+enum RECTYPE
+{
+	RECT_END,		// なし。記録を終えた時刻
+	RECT_OUT,		// 長さ、データ	: PCが送ったOUTのパケット（入力）
+	RECT_HOSTCMD,	// データ		: ホストがコマンドの送信要求を出した（入力）
+	RECT_IN,		// 長さ、データ	: PCに届いたINのメッセージ
+	RECT_HOSTLINE,	// ライン × 2 + レベル : ホストの出力が変わった（SIM_CLK、SIM_DAT。0:Lにする、1:離す）
+	RECT_DEVBYTE,	// データ、エラー	: ホストがデバイスから受け取ったバイト（HOSTERR_*）
+	RECT_HOSTBYTE,	// データ		: デバイスがホストから受け取ったバイト（PS2_PROBE_RX_DONE）
+	RECT_NUM
+};
+
+struct RECORD
+{
+	simtime_t t;
+	uint8_t type;		// RECT_*
+	uint8_t len;
+	uint8_t dt[RECLOG_DATA_MAX];	// RECT_DEVBYTE は dt[0] がデータ、dt[1] がエラー
+};
+
+struct RECLOG
+{
+	uint8_t model;
+	uint16_t clkRise;
+	uint16_t datRise;
+	struct RECORD *rec;		// 時刻の順。最後は RECT_END
+	int num;
+	int cap;
+};
+
+void reclog_Init(struct RECLOG *log);
+void reclog_Free(struct RECLOG *log);
+struct RECORD *reclog_Add(struct RECLOG *log, simtime_t t, uint8_t type);
+// 時刻の順に並べる（同じ時刻なら加えた順）
+void reclog_Sort(struct RECLOG *log);
+bool reclog_Save(const struct RECLOG *log, const char *path);
+// @return 読めたか。読めなければ理由を表示する
+bool reclog_Load(struct RECLOG *log, const char *path);
+// 入力のレコードか
+bool reclog_IsInput(uint8_t type);
+// r を1行で表示する
+void reclog_Print(FILE *fp, const struct RECORD *r);
+
+#endif
@@ -0,0 +1,33 @@
+/*********************************************************************
+* inc/xc.h で宣言したレジスタの実体
+*	TMR1（mcu.c）、UIR・USTAT（usb/sie_fake.c）のように読み書きに副作用があるものは、それぞれのファイルにある。
+*	UCONは、PPBRST（ピンポンのポインタのリセット）を偽のSIEが知るためだけに関数を通す。
+*/
+#include <xc.h>
+
+volatile SIM_LATC_t SIM_LATC;
+volatile SIM_INTCON_t SIM_INTCON;
+volatile SIM_INTCON2_t SIM_INTCON2;
+volatile SIM_INTCON3_t SIM_INTCON3;
+volatile SIM_PIR1_t SIM_PIR1, SIM_PIE1, SIM_IPR1;
+volatile SIM_PIR2_t SIM_PIR2, SIM_PIE2, SIM_IPR2;
+volatile SIM_RCON_t SIM_RCON;
+volatile SIM_T1CON_t SIM_T1CON;
+volatile SIM_T2CON_t SIM_T2CON;
+volatile uint8_t PR2, TMR2;
+volatile uint8_t LATA, LATB, TRISA, TRISB, TRISC, ANSEL, ANSELH, WPUA, WPUB, IOCA, IOCB;
+volatile uint8_t OSCCON, OSCCON2, OSCTUNE;
+
+volatile SIM_UIR_t SIM_UIE;
+volatile uint8_t UEIR, UEIE, UADDR, UCFG;
+volatile SIM_UEP_t SIM_UEP[16];
+
+static volatile SIM_UCON_t s_UCON;
+uint32_t g_SimPpbRst;
+
+volatile SIM_UCON_t *sim_UCON(void)
+{
+	if (s_UCON.PPBRST)
+		++g_SimPpbRst;
+	return &s_UCON;
+}
@@ -0,0 +1,109 @@
+/*********************************************************************
+* ファームウェアの実行（sim.h）
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "sim.h"
+#include "pc.h"
+
+#define FW_STACK_SIZE	(256 * 1024)
+
+uint64_t g_SimLoops;
+
+static ucontext_t s_Driver;
+static ucontext_t s_Firmware;
+static char *s_Stack;
+static simtime_t s_Until;
+static bool (*s_Cond)(void);
+static bool s_Met;
+
+void fw_main(void);		// main.c の main()
+
+// ファームウェアとレジスタ（sfr.c）の変数。Makefile がセクションの名前を変えて集めている
+extern char __start_fw_data[], __stop_fw_data[], __start_fw_bss[], __stop_fw_bss[];
+static char *s_DataImage;	// fw_data の初期値
+
+// 電源投入と同じく、変数を初期値に戻す（XC8 のスタートアップが .data をコピーし .bss を0にするのと同じ）
+static void powerOnRam(void)
+{
+	const size_t dataSize = (size_t)(__stop_fw_data - __start_fw_data);
+	if (s_DataImage == NULL) {
+		s_DataImage = malloc(dataSize + 1);
+		if (s_DataImage == NULL)
+			abort();
+		memcpy(s_DataImage, __start_fw_data, dataSize);
+	}
+	else
+		memcpy(__start_fw_data, s_DataImage, dataSize);
+	memset(__start_fw_bss, 0, (size_t)(__stop_fw_bss - __start_fw_bss));
+	return;
+}
+
+static void firmwareEntry(void)
+{
+	fw_main();
+	fprintf(stderr, "sim: main() returned\n");
+	abort();
+}
+
+static void resume(void)
+{
+	if (swapcontext(&s_Driver, &s_Firmware) != 0) {
+		perror("swapcontext");
+		abort();
+	}
+	return;
+}
+
+void sim_Start(void)
+{
+	if (s_Stack == NULL) {
+		s_Stack = malloc(FW_STACK_SIZE);
+		if (s_Stack == NULL)
+			abort();
+	}
+	powerOnRam();
+	getcontext(&s_Firmware);
+	s_Firmware.uc_stack.ss_sp = s_Stack;
+	s_Firmware.uc_stack.ss_size = FW_STACK_SIZE;
+	s_Firmware.uc_link = NULL;
+	makecontext(&s_Firmware, firmwareEntry, 0);
+	g_SimLoops = 0;
+	s_Until = g_SimNow;
+	s_Cond = NULL;
+	resume();
+	return;
+}
+
+void sim_RunFor(const simtime_t cyc)
+{
+	s_Until = g_SimNow + cyc;
+	s_Cond = NULL;
+	resume();
+	return;
+}
+
+bool sim_RunUntil(bool (*cond)(void), const simtime_t timeout)
+{
+	if (cond())
+		return true;
+	s_Until = g_SimNow + timeout;
+	s_Cond = cond;
+	s_Met = false;
+	resume();
+	s_Cond = NULL;
+	return s_Met;
+}
+
+void sim_LoopEnd(void)
+{
+	++g_SimLoops;
+	if (s_Cond != NULL && s_Cond())
+		s_Met = true;
+	else if (g_SimNow < s_Until)
+		return;
+	swapcontext(&s_Firmware, &s_Driver);
+	return;
+}
@@ -0,0 +1,29 @@
+#ifndef SIM_SIM_H
+#define SIM_SIM_H
+
+/*********************************************************************
+* ファームウェアの実行
+*	main.c の main()（fw_main() に名前を変えてある）を別のスタックで動かし、
+*	メインループ1周ごと（CDCTxService() の終わり）に、指定の時刻になったか、条件を満たしたかを調べて戻ってくる。
+*	シナリオは sim_Start() の後、sim_RunFor()、sim_RunUntil() でファームウェアを進めながら、
+*	ホストモデル（host.h）とPC（pc.h）を操作する。
+*/
+
+#include <stdbool.h>
+#include "mcu.h"
+
+extern uint64_t g_SimLoops;	// メインループを回った回数
+
+// ファームウェアを main() の最初から、最初のメインループの終わりまで動かす。
+// ファームウェアの変数とレジスタは、呼ぶたびに電源投入時の値に戻す。
+// 先に mcu_Reset()、pc_Reset() をして、ホストモデルなどをつないでおくこと
+void sim_Start(void);
+// ファームウェアを cyc だけ動かす
+void sim_RunFor(simtime_t cyc);
+// cond() が true を返すまで、最大 timeout だけ動かす。@return cond() が true になったか
+bool sim_RunUntil(bool (*cond)(void), simtime_t timeout);
+
+// cdc_fake.c の CDCTxService() から呼ぶ
+void sim_LoopEnd(void);
+
+#endif
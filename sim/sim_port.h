@@ -0,0 +1,47 @@
+#ifndef SIM_PORT_H
+#define SIM_PORT_H
+
+// ps2_port.h の PS2_PORT_HEADER。ピンの入出力と待ち時間をシミュレーション（mcu.c）につなぐ。
+
+#include "mcu.h"
+
+static const int OUT_H = 0;
+static const int OUT_L = 1;
+static const int IN_H = 1;
+static const int IN_L = 0;
+
+static inline uint8_t PS2POW_IN()
+{
+	return mcu_PowIn();
+}
+
+static inline uint8_t CLK_IN()
+{
+	return mcu_DevIn(SIM_CLK);
+}
+
+static inline uint8_t DAT_IN()
+{
+	return mcu_DevIn(SIM_DAT);
+}
+
+static inline void CLK_OUT(int t)
+{
+	mcu_DevOut(SIM_CLK, t);
+	return;
+}
+
+static inline void DAT_OUT(int t)
+{
+	mcu_DevOut(SIM_DAT, t);
+	return;
+}
+
+#define PS2_DELAY_US(us)			mcu_Advance(SIM_US(us))
+
+#define PS2_PROBE_USB_RX(p, n)		mcu_ProbeUsbRx((p), (n))
+#define PS2_PROBE_TX_DONE(dt)		mcu_ProbeTxDone(dt)
+#define PS2_PROBE_RX_DONE(dt)		mcu_ProbeRxDone(dt)
+#define PS2_PROBE_RX_STATE(st)		mcu_ProbeRxState(st)
+
+#endif
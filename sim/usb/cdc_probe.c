@@ -0,0 +1,57 @@
+/*********************************************************************
+* usb_device_cdc.c の計測（cdc_probe.h）
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cdc_probe.h"
+
+struct CDC_PROBE_COUNT g_CdcProbe[CDC_PROBE_ID_NUM];
+static uint64_t s_EnterAt[CDC_PROBE_ID_NUM];
+
+static const char *const s_Name[CDC_PROBE_ID_NUM] = {
+	"getsUSBUSART",
+	"putUSBUSART",
+	"CDCTxService",
+};
+
+static uint64_t readCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void cdcprobe_Enter(const enum CDC_PROBE_ID id)
+{
+	++g_CdcProbe[id].calls;
+	s_EnterAt[id] = readCycles();
+	return;
+}
+
+void cdcprobe_Leave(const enum CDC_PROBE_ID id)
+{
+	g_CdcProbe[id].cycles += readCycles() - s_EnterAt[id];
+	return;
+}
+
+void cdcprobe_Clear(void)
+{
+	memset(g_CdcProbe, 0, sizeof(g_CdcProbe));
+	return;
+}
+
+void cdcprobe_Print(const char *title)
+{
+	printf("%s:\n", title);
+	for (int i = 0; i < CDC_PROBE_ID_NUM; ++i) {
+		const struct CDC_PROBE_COUNT *p = &g_CdcProbe[i];
+		printf("  %-13s calls %7u  copied %7u bytes  %7.1f cycles/call\n", s_Name[i],
+			p->calls, p->copyBytes, p->calls ? (double)p->cycles / p->calls : 0.0);
+	}
+	return;
+}
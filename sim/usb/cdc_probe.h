@@ -0,0 +1,39 @@
+#ifndef SIM_CDC_PROBE_H
+#define SIM_CDC_PROBE_H
+
+/*********************************************************************
+* usb_device_cdc.c の計測用のフック（CDC_PROBE_HEADER）
+*	getsUSBUSART()、putUSBUSART()、CDCTxService() について、呼ばれた回数、コピーしたバイト数、
+*	かかった時間（ホストPCのサイクル）を数える。実機の命令サイクルではないので、比べるのは
+*	同じホストPCで測った値どうしに限ること。コピーしたバイト数は実機と同じになる。
+*/
+
+#include <stdint.h>
+
+enum CDC_PROBE_ID
+{
+	CDC_PROBE_ID_getsUSBUSART,
+	CDC_PROBE_ID_putUSBUSART,
+	CDC_PROBE_ID_CDCTxService,
+	CDC_PROBE_ID_NUM
+};
+
+struct CDC_PROBE_COUNT
+{
+	uint32_t calls;
+	uint32_t copyBytes;
+	uint64_t cycles;
+};
+extern struct CDC_PROBE_COUNT g_CdcProbe[CDC_PROBE_ID_NUM];
+
+void cdcprobe_Enter(enum CDC_PROBE_ID id);
+void cdcprobe_Leave(enum CDC_PROBE_ID id);
+void cdcprobe_Clear(void);
+// 名前、回数、コピーしたバイト数、1回あたりのサイクルを表示する
+void cdcprobe_Print(const char *title);
+
+#define CDC_PROBE_ENTER(fn)		cdcprobe_Enter(CDC_PROBE_ID_##fn)
+#define CDC_PROBE_LEAVE(fn)		cdcprobe_Leave(CDC_PROBE_ID_##fn)
+#define CDC_PROBE_COPY(fn, n)	(g_CdcProbe[CDC_PROBE_ID_##fn].copyBytes += (n))
+
+#endif
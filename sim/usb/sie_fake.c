@@ -0,0 +1,229 @@
+/*********************************************************************
+* USBモジュール（SIE）の偽物（sie_fake.h）
+*/
+#include <xc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usb.h"
+#include "usb_device_local.h"
+#include "sie_fake.h"
+
+#if (USB_PING_PONG_MODE != USB_PING_PONG__FULL_PING_PONG)
+#error "sie_fake.c はピンポンバッファをすべてのエンドポイントで使う設定のみ対応"
+#endif
+
+#define USTAT_FIFO_SIZE		4
+#define ADR_TABLE_MAX		32
+#define EP_NUM				(USB_MAX_EP_NUMBER + 1)
+#define DIR_OUT				0
+#define DIR_IN				1
+
+extern volatile BDT_ENTRY BDT[BDT_NUM_ENTRIES];
+
+static volatile SIM_UIR_t s_UIR;
+static uint8_t s_Ustat[USTAT_FIFO_SIZE];		// USTAT のFIFO
+static uint8_t s_UstatHead, s_UstatNum;
+static uint8_t s_UstatEmpty;
+static uint8_t s_PingPong[EP_NUM][2];			// 次に使うBD（0:偶数、1:奇数）
+static uint32_t s_PpbRstSeen;					// 最後に見た g_SimPpbRst
+static uint32_t s_ErrCount;
+
+// BDTのアドレス（ADR）とポインタの対応。0 は NULL
+static const volatile void *s_AdrTable[ADR_TABLE_MAX];
+static int s_AdrNum;
+
+uint16_t sim_UsbPhysAddr(const volatile void *p)
+{
+	if (p == NULL)
+		return 0;
+	for (int i = 0; i < s_AdrNum; ++i) {
+		if (s_AdrTable[i] == p)
+			return (uint16_t)(i + 1);
+	}
+	if (s_AdrNum == ADR_TABLE_MAX) {
+		fprintf(stderr, "sie_fake: too many buffer addresses\n");
+		abort();
+	}
+	s_AdrTable[s_AdrNum++] = p;
+	return (uint16_t)s_AdrNum;
+}
+
+void *sim_UsbVirtAddr(const uint16_t adr)
+{
+	if (adr == 0)
+		return NULL;
+	if (s_AdrNum < adr) {
+		fprintf(stderr, "sie_fake: unknown buffer address %04X\n", adr);
+		abort();
+	}
+	return (void *)(uintptr_t)s_AdrTable[adr - 1];
+}
+
+// TRNIF を落とされたら、FIFOの先頭（USTAT）を捨てて次の転送を見せる
+volatile SIM_UIR_t *sim_UIR(void)
+{
+	if (s_UstatNum != 0 && !s_UIR.TRNIF) {
+		s_UstatHead = (s_UstatHead + 1) % USTAT_FIFO_SIZE;
+		--s_UstatNum;
+		if (s_UstatNum != 0)
+			s_UIR.TRNIF = 1;
+	}
+	return &s_UIR;
+}
+
+volatile uint8_t *sim_USTAT(void)
+{
+	if (s_UstatNum == 0)
+		return &s_UstatEmpty;
+	return &s_Ustat[s_UstatHead];
+}
+
+static void syncPingPong(void)
+{
+	if (s_PpbRstSeen == g_SimPpbRst)
+		return;
+	s_PpbRstSeen = g_SimPpbRst;
+	memset(s_PingPong, 0, sizeof(s_PingPong));
+	return;
+}
+
+static volatile BDT_ENTRY *currentBd(const uint8_t ep, const uint8_t dir)
+{
+	syncPingPong();
+	return &BDT[EP(ep, dir, s_PingPong[ep][dir])];
+}
+
+// 転送を終えたBDをスタックに返す
+static void complete(const uint8_t ep, const uint8_t dir, volatile BDT_ENTRY *bd, const uint8_t pid,
+	const uint8_t cnt, const bool bData1)
+{
+	const uint8_t pp = s_PingPong[ep][dir];
+
+	bd->CNT = cnt;
+	bd->STAT.Val = (bData1 ? _DTSMASK : 0) | (uint8_t)(pid << 2);
+	s_Ustat[(s_UstatHead + s_UstatNum) % USTAT_FIFO_SIZE] = (uint8_t)((ep << 3) | (dir << 2) | (pp << 1));
+	if (s_UstatNum++ == 0)
+		s_UIR.TRNIF = 1;
+	s_PingPong[ep][dir] ^= 1;
+	return;
+}
+
+// トークンに応答するか。ACK、NAK以外を返したときはトークンを処理しない
+static enum SIE_RESULT accept(const uint8_t addr, const uint8_t ep, const uint8_t dir)
+{
+	if (!UCONbits.USBEN || addr != UADDR || EP_NUM <= ep)
+		return SIE_NORESP;
+	if (!(dir == DIR_IN ? SIM_UEP[ep].EPINEN : SIM_UEP[ep].EPOUTEN))
+		return SIE_NORESP;
+	if (SIM_UEP[ep].EPSTALL) {
+		s_UIR.STALLIF = 1;
+		return SIE_STALL;
+	}
+	if (s_UstatNum == USTAT_FIFO_SIZE)
+		return SIE_NAK;
+	if (ep == 0 && UCONbits.PKTDIS)
+		return SIE_NAK;
+	return SIE_ACK;
+}
+
+void sie_Reset(void)
+{
+	memset((void *)&s_UIR, 0, sizeof(s_UIR));
+	s_UstatHead = s_UstatNum = 0;
+	memset(s_PingPong, 0, sizeof(s_PingPong));
+	s_PpbRstSeen = g_SimPpbRst;
+	s_ErrCount = 0;
+	UCON = 0;
+	UADDR = 0;
+	memset((void *)SIM_UEP, 0, sizeof(SIM_UEP));
+	return;
+}
+
+void sie_BusReset(void)
+{
+	UADDR = 0;
+	memset(s_PingPong, 0, sizeof(s_PingPong));
+	s_UIR.URSTIF = 1;
+	return;
+}
+
+void sie_Frame(void)
+{
+	if (UCONbits.USBEN)
+		s_UIR.SOFIF = 1;
+	return;
+}
+
+enum SIE_RESULT sie_Setup(const uint8_t addr, const uint8_t pkt[8])
+{
+	// SETUP には PKTDIS に関係なく応答する
+	if (!UCONbits.USBEN || addr != UADDR || !SIM_UEP[0].EPOUTEN)
+		return SIE_NORESP;
+	if (s_UstatNum == USTAT_FIFO_SIZE)
+		return SIE_NAK;
+	volatile BDT_ENTRY *bd = currentBd(0, DIR_OUT);
+	if (!bd->STAT.UOWN)
+		return SIE_NAK;
+	if (bd->CNT < 8) {
+		++s_ErrCount;
+		return SIE_NORESP;
+	}
+	memcpy(sim_UsbVirtAddr(bd->ADR), pkt, 8);
+	complete(0, DIR_OUT, bd, PID_SETUP, 8, false);
+	UCONbits.PKTDIS = 1;
+	return SIE_ACK;
+}
+
+enum SIE_RESULT sie_Out(const uint8_t addr, const uint8_t ep, const uint8_t *p, const uint8_t n, const bool bData1)
+{
+	enum SIE_RESULT r = accept(addr, ep, DIR_OUT);
+	if (r != SIE_ACK)
+		return r;
+	volatile BDT_ENTRY *bd = currentBd(ep, DIR_OUT);
+	if (!bd->STAT.UOWN)
+		return SIE_NAK;
+	if (bd->STAT.Val & _BSTALL) {
+		s_UIR.STALLIF = 1;
+		return SIE_STALL;
+	}
+	if (bd->CNT < n) {
+		++s_ErrCount;
+		return SIE_NORESP;
+	}
+	if ((bd->STAT.Val & _DTSEN) && ((bd->STAT.Val & _DTSMASK) != 0) != bData1) {
+		++s_ErrCount;
+		return SIE_ACK;
+	}
+	if (n != 0)
+		memcpy(sim_UsbVirtAddr(bd->ADR), p, n);
+	complete(ep, DIR_OUT, bd, PID_OUT, n, bData1);
+	return SIE_ACK;
+}
+
+enum SIE_RESULT sie_In(const uint8_t addr, const uint8_t ep, uint8_t *p, uint8_t *pN, bool *pData1)
+{
+	enum SIE_RESULT r = accept(addr, ep, DIR_IN);
+	if (r != SIE_ACK)
+		return r;
+	volatile BDT_ENTRY *bd = currentBd(ep, DIR_IN);
+	if (!bd->STAT.UOWN)
+		return SIE_NAK;
+	if (bd->STAT.Val & _BSTALL) {
+		s_UIR.STALLIF = 1;
+		return SIE_STALL;
+	}
+	const uint8_t n = bd->CNT;
+	const bool bData1 = (bd->STAT.Val & _DTSMASK) != 0;
+	if (n != 0)
+		memcpy(p, sim_UsbVirtAddr(bd->ADR), n);
+	*pN = n;
+	*pData1 = bData1;
+	complete(ep, DIR_IN, bd, PID_IN, n, bData1);
+	return SIE_ACK;
+}
+
+uint32_t sie_ErrCount(void)
+{
+	return s_ErrCount;
+}
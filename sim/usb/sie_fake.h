@@ -0,0 +1,40 @@
+#ifndef SIM_SIE_FAKE_H
+#define SIM_SIE_FAKE_H
+
+/*********************************************************************
+* PIC18F14K50 のUSBモジュール（SIE）の偽物
+*	本物のUSBスタック（cdc/usb_device.c、usb_device_cdc.c）が書いたBDTを読んで、USBホストが出した
+*	トークン（SETUP、OUT、IN）を処理する。本物と同じように
+*		・UOWN が立っていないBDにはNAKを返し、BSTALL が立っていればSTALLを返す
+*		・ピンポンのポインタはエンドポイントと方向ごとにSIEが持ち、転送が終わるたびに切り替える
+*		  （PPBRST で偶数側に戻る）
+*		・転送が終わるとBDの UOWN を落としてPIDと長さを書き、USTAT のFIFO（4段）に積んで TRNIF を立てる
+*		・SETUP を受け取ると PKTDIS を立て、スタックが落とすまでEP0のトークンにNAKを返す
+*		・UADDR と違うアドレスのトークン、有効にしていないエンドポイントのトークンには応答しない
+*	DTSEN のBDで、データトグルが合わないOUTのパケットは本物と同じく捨てる（ACKは返す）。
+*	これとバッファのあふれは sie_ErrCount() で数える。
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum SIE_RESULT
+{
+	SIE_ACK,
+	SIE_NAK,
+	SIE_STALL,
+	SIE_NORESP,		// 応答なし（アドレス違い、無効なエンドポイント、バッファあふれ）
+};
+
+void sie_Reset(void);			// 電源投入
+void sie_BusReset(void);		// ホストがバスリセットを出した
+void sie_Frame(void);			// フレームの始まり（SOF）
+
+enum SIE_RESULT sie_Setup(uint8_t addr, const uint8_t pkt[8]);
+enum SIE_RESULT sie_Out(uint8_t addr, uint8_t ep, const uint8_t *p, uint8_t n, bool bData1);
+// ACKのとき、p に受け取ったデータを、*pN に長さを、*pData1 にデータトグルを入れる
+enum SIE_RESULT sie_In(uint8_t addr, uint8_t ep, uint8_t *p, uint8_t *pN, bool *pData1);
+
+uint32_t sie_ErrCount(void);
+
+#endif
@@ -0,0 +1,359 @@
+/*********************************************************************
+* 本物のUSBスタック（cdc/usb_device.c、usb_device_cdc.c）を偽のSIE（sie_fake.c）で動かして確かめる
+*	ホストPCの側（このファイル）がSETUP、OUT、INのトークンを出し、デバイスの側は main.c と同じく
+*	USBDeviceTasks()、アプリケーション、CDCTxService() の順に回す。アプリケーションは受け取った
+*	パケットをそのまま送り返す。
+*
+*	使い方: usbsim
+*		1. 接続、バスリセット、ディスクリプタの読み出し、SET_ADDRESS、SET_CONFIGURATION、
+*		   CDCのクラスリクエストが通ること（ディスクリプタは usb_descriptors.c と同じか）
+*		2. getsUSBUSART() でコピーして受け取る場合と、CDCRxGetPacket() で貸してもらう場合のそれぞれで、
+*		   長さ 1〜64 のパケットが送り返されること（64バイトのときはゼロ長パケットが続くこと）
+*		3. パケットを貸している間は、次のOUTにNAKを返すこと（OUTのバッファは1つ）
+*		4. データトグルとBDのあふれのエラーがないこと
+*	それぞれの受け取り方で、getsUSBUSART()、putUSBUSART()、CDCTxService() の回数、コピーしたバイト数、
+*	サイクル（cdc_probe.h）を表示する。コピーしたバイト数は、送ったバイト数と比べて確かめる。
+*	成功したら 0、失敗したら 1 で終わる。
+*/
+#include <xc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app.h"
+#include "usb.h"
+#include "usb_device.h"
+#include "usb_device_cdc.h"
+#include "sie_fake.h"
+#include "cdc_probe.h"
+
+#define DEV_ADDR			5
+#define TASKS_PER_FRAME		8		// 1フレームの間にメインループが回る回数
+#define RETRY_MAX			64		// NAKが続いたときに、メインループを回して待つ回数
+#define ECHO_PACKETS		2000
+
+#define DIR_OUT				0
+#define DIR_IN				1
+
+static int s_Fail;
+
+#define CHECK(cond, ...)	do { if (!(cond)) { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); ++s_Fail; } } while (0)
+
+extern const USB_DEVICE_DESCRIPTOR device_dsc;
+extern const uint8_t *const USB_CD_Ptr[];
+
+void APP_SYSTEM_Initialize(APP_SYSTEM_STATE state)
+{
+	(void)state;
+	return;
+}
+
+/*********************************************************************
+* デバイスの側
+*/
+enum ECHO_MODE
+{
+	ECHO_GETS,		// getsUSBUSART() でコピーして受け取る
+	ECHO_LEND,		// CDCRxGetPacket() で貸してもらい、返信を作ってから CDCRxReleasePacket() で返す
+};
+static enum ECHO_MODE s_EchoMode;
+static bool s_EchoHold;						// ECHO_LEND で、借りたパケットを返さずに持っておく
+static bool s_EchoLent;
+static uint8_t s_EchoBuff[CDC_DATA_OUT_EP_SIZE];	// putUSBUSART() に渡すのでstatic
+static uint8_t s_EchoLen;
+static bool s_EchoPending;
+
+static void echoTask(void)
+{
+	if (USBGetDeviceState() < CONFIGURED_STATE)
+		return;
+	if (s_EchoPending) {
+		if (!USBUSARTIsTxTrfReady())
+			return;
+		putUSBUSART(s_EchoBuff, s_EchoLen);
+		s_EchoPending = false;
+	}
+	if (s_EchoMode == ECHO_GETS) {
+		s_EchoLen = getsUSBUSART(s_EchoBuff, sizeof(s_EchoBuff));
+		s_EchoPending = (s_EchoLen != 0);
+		return;
+	}
+	if (!s_EchoLent) {
+		uint8_t n;
+		volatile uint8_t *p = CDCRxGetPacket(&n);
+		if (p == NULL)
+			return;
+		for (uint8_t i = 0; i < n; ++i)
+			s_EchoBuff[i] = p[i];
+		s_EchoLen = n;
+		s_EchoPending = (n != 0);
+		s_EchoLent = true;
+	}
+	if (!s_EchoHold) {
+		CDCRxReleasePacket();
+		s_EchoLent = false;
+	}
+	return;
+}
+
+// main.c のメインループ1回分
+static void devTask(void)
+{
+	USBDeviceTasks();
+	echoTask();
+	CDCTxService();
+	return;
+}
+
+static void frame(void)
+{
+	sie_Frame();
+	for (int i = 0; i < TASKS_PER_FRAME; ++i)
+		devTask();
+	return;
+}
+
+/*********************************************************************
+* ホストPCの側
+*/
+static uint8_t s_Addr;
+static bool s_Toggle[USB_MAX_EP_NUMBER + 1][2];	// 次のパケットのデータトグル（true:DATA1）
+static uint32_t s_ToggleErr;
+
+static enum SIE_RESULT setupWait(const uint8_t pkt[8])
+{
+	enum SIE_RESULT r = SIE_NAK;
+	for (int i = 0; i < RETRY_MAX && r == SIE_NAK; ++i) {
+		r = sie_Setup(s_Addr, pkt);
+		devTask();
+	}
+	s_Toggle[0][DIR_OUT] = s_Toggle[0][DIR_IN] = true;
+	return r;
+}
+
+static enum SIE_RESULT outWait(const uint8_t ep, const uint8_t *p, const uint8_t n)
+{
+	enum SIE_RESULT r = SIE_NAK;
+	for (int i = 0; i < RETRY_MAX && r == SIE_NAK; ++i) {
+		r = sie_Out(s_Addr, ep, p, n, s_Toggle[ep][DIR_OUT]);
+		devTask();
+	}
+	if (r == SIE_ACK)
+		s_Toggle[ep][DIR_OUT] = !s_Toggle[ep][DIR_OUT];
+	return r;
+}
+
+// @return 受け取った長さ。NAKが続いたときは -1
+static int inWait(const uint8_t ep, uint8_t *p)
+{
+	enum SIE_RESULT r = SIE_NAK;
+	uint8_t n = 0;
+	bool bData1 = false;
+	for (int i = 0; i < RETRY_MAX && r == SIE_NAK; ++i) {
+		r = sie_In(s_Addr, ep, p, &n, &bData1);
+		devTask();
+	}
+	if (r != SIE_ACK)
+		return -1;
+	if (bData1 != s_Toggle[ep][DIR_IN])
+		++s_ToggleErr;
+	s_Toggle[ep][DIR_IN] = !bData1;
+	return n;
+}
+
+// コントロール転送。データステージが IN なら data に受け取る。
+// @return データステージで送受信した長さ。失敗したら -1
+static int control(const uint8_t setup[8], uint8_t *data)
+{
+	const bool bIn = (setup[0] & 0x80) != 0;
+	const int len = setup[6] | (setup[7] << 8);
+	int done = 0;
+
+	if (setupWait(setup) != SIE_ACK)
+		return -1;
+	while (done < len) {
+		if (bIn) {
+			const int n = inWait(0, data + done);
+			if (n < 0)
+				return -1;
+			done += n;
+			if (n < USB_EP0_BUFF_SIZE)
+				break;
+		} else {
+			const int n = (len - done < USB_EP0_BUFF_SIZE) ? len - done : USB_EP0_BUFF_SIZE;
+			if (outWait(0, data + done, (uint8_t)n) != SIE_ACK)
+				return -1;
+			done += n;
+		}
+	}
+	// ステータスステージは DATA1 のゼロ長パケット
+	s_Toggle[0][DIR_OUT] = s_Toggle[0][DIR_IN] = true;
+	if (bIn && len != 0) {
+		if (outWait(0, NULL, 0) != SIE_ACK)
+			return -1;
+	} else {
+		uint8_t zlp[USB_EP0_BUFF_SIZE];
+		if (inWait(0, zlp) != 0)
+			return -1;
+	}
+	devTask();
+	return done;
+}
+
+static int getDescriptor(const uint8_t type, const uint8_t idx, uint8_t *p, const uint16_t len)
+{
+	const uint8_t setup[8] = { 0x80, USB_REQUEST_GET_DESCRIPTOR, idx, type, 0, 0, (uint8_t)len, (uint8_t)(len >> 8) };
+	return control(setup, p);
+}
+
+static bool request(const uint8_t reqType, const uint8_t req, const uint16_t value, uint8_t *data, const uint16_t len)
+{
+	const uint8_t setup[8] = { reqType, req, (uint8_t)value, (uint8_t)(value >> 8), 0, 0, (uint8_t)len, (uint8_t)(len >> 8) };
+	return control(setup, data) == len;
+}
+
+/*********************************************************************
+* シナリオ
+*/
+static void enumerate(void)
+{
+	uint8_t buff[256];
+
+	sie_Reset();
+	USBDeviceInit();
+	s_Addr = 0;
+	for (int i = 0; i < 4; ++i)
+		frame();
+	CHECK(USBGetDeviceState() == POWERED_STATE, "attach: state %d", USBGetDeviceState());
+
+	sie_BusReset();
+	frame();
+	CHECK(USBGetDeviceState() == DEFAULT_STATE, "bus reset: state %d", USBGetDeviceState());
+
+	int n = getDescriptor(USB_DESCRIPTOR_DEVICE, 0, buff, 64);
+	CHECK(n == sizeof(device_dsc) && memcmp(buff, &device_dsc, sizeof(device_dsc)) == 0,
+		"device descriptor: got %d bytes", n);
+
+	CHECK(request(0x00, USB_REQUEST_SET_ADDRESS, DEV_ADDR, NULL, 0), "SET_ADDRESS failed");
+	frame();
+	s_Addr = DEV_ADDR;
+	CHECK(UADDR == DEV_ADDR && USBGetDeviceState() == ADDRESS_STATE, "SET_ADDRESS: UADDR %d, state %d",
+		UADDR, USBGetDeviceState());
+
+	n = getDescriptor(USB_DESCRIPTOR_CONFIGURATION, 0, buff, 9);
+	const uint16_t total = (uint16_t)(USB_CD_Ptr[0][2] | (USB_CD_Ptr[0][3] << 8));
+	CHECK(n == 9 && memcmp(buff, USB_CD_Ptr[0], 9) == 0, "configuration descriptor header: got %d bytes", n);
+	n = getDescriptor(USB_DESCRIPTOR_CONFIGURATION, 0, buff, total);
+	CHECK(n == total && memcmp(buff, USB_CD_Ptr[0], total) == 0, "configuration descriptor: got %d of %u bytes",
+		n, total);
+	for (uint8_t i = 0; i < USB_NUM_STRING_DESCRIPTORS; ++i) {
+		n = getDescriptor(USB_DESCRIPTOR_STRING, i, buff, 255);
+		CHECK(0 < n && n == buff[0], "string descriptor %u: got %d bytes", i, n);
+	}
+
+	CHECK(request(0x00, USB_REQUEST_SET_CONFIGURATION, 1, NULL, 0), "SET_CONFIGURATION failed");
+	frame();
+	CHECK(USBGetDeviceState() == CONFIGURED_STATE, "SET_CONFIGURATION: state %d", USBGetDeviceState());
+	for (int ep = 1; ep <= USB_MAX_EP_NUMBER; ++ep)
+		s_Toggle[ep][DIR_OUT] = s_Toggle[ep][DIR_IN] = false;
+
+	uint8_t coding[7] = { 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 };	// 115200bps、8N1
+	uint8_t got[7];
+	CHECK(request(0x21, SET_LINE_CODING, 0, coding, sizeof(coding)), "SET_LINE_CODING failed");
+	CHECK(request(0xA1, GET_LINE_CODING, 0, got, sizeof(got)) && memcmp(coding, got, sizeof(got)) == 0,
+		"GET_LINE_CODING: mismatch");
+	CHECK(request(0x21, SET_CONTROL_LINE_STATE, 0x0003, NULL, 0), "SET_CONTROL_LINE_STATE failed");
+	return;
+}
+
+static uint32_t s_Rand = 1;
+static uint32_t simRand(const uint32_t n)
+{
+	s_Rand = s_Rand * 1103515245u + 12345u;
+	return (s_Rand >> 8) % n;
+}
+
+// 送り返されたパケットを、短いパケット（ゼロ長を含む）まで受け取る
+static int echoRead(uint8_t *p, const int max)
+{
+	int done = 0;
+	for (;;) {
+		uint8_t pkt[CDC_DATA_IN_EP_SIZE];
+		const int n = inWait(CDC_DATA_EP, pkt);
+		if (n < 0 || max < done + n)
+			return -1;
+		memcpy(p + done, pkt, (size_t)n);
+		done += n;
+		if (n < CDC_DATA_IN_EP_SIZE)
+			return done;
+	}
+}
+
+static void scenarioEcho(const enum ECHO_MODE mode, const char *title)
+{
+	uint32_t sent = 0;
+	int fail = 0;
+
+	s_EchoMode = mode;
+	cdcprobe_Clear();
+	for (int i = 0; i < ECHO_PACKETS; ++i) {
+		uint8_t pkt[CDC_DATA_OUT_EP_SIZE], got[CDC_DATA_OUT_EP_SIZE * 2];
+		const uint8_t n = (uint8_t)(1 + simRand(CDC_DATA_OUT_EP_SIZE));
+		for (uint8_t k = 0; k < n; ++k)
+			pkt[k] = (uint8_t)simRand(256);
+		if (outWait(CDC_DATA_EP, pkt, n) != SIE_ACK) {
+			++fail;
+			continue;
+		}
+		sent += n;
+		const int m = echoRead(got, sizeof(got));
+		if (m != n || memcmp(pkt, got, n) != 0)
+			++fail;
+		if (simRand(8) == 0)
+			frame();
+	}
+	CHECK(fail == 0, "%s: %d of %d packets were not echoed", title, fail, ECHO_PACKETS);
+	cdcprobe_Print(title);
+	// 受け取り: getsUSBUSART() だけがコピーする。送信: putUSBUSART() はポインタを覚えるだけで、
+	// CDCTxService() がエンドポイントのバッファへコピーする
+	const uint32_t getsCopy = (mode == ECHO_GETS) ? sent : 0;
+	CHECK(g_CdcProbe[CDC_PROBE_ID_getsUSBUSART].copyBytes == getsCopy, "%s: getsUSBUSART copied %u bytes, expected %u",
+		title, g_CdcProbe[CDC_PROBE_ID_getsUSBUSART].copyBytes, getsCopy);
+	CHECK(g_CdcProbe[CDC_PROBE_ID_putUSBUSART].copyBytes == 0, "%s: putUSBUSART copied %u bytes",
+		title, g_CdcProbe[CDC_PROBE_ID_putUSBUSART].copyBytes);
+	CHECK(g_CdcProbe[CDC_PROBE_ID_CDCTxService].copyBytes == sent, "%s: CDCTxService copied %u bytes, expected %u",
+		title, g_CdcProbe[CDC_PROBE_ID_CDCTxService].copyBytes, sent);
+	return;
+}
+
+// パケットを貸している間は、次のOUTにNAKを返す
+static void scenarioLent(void)
+{
+	const uint8_t a[1] = { 0x11 }, b[1] = { 0x22 };
+	uint8_t got[CDC_DATA_IN_EP_SIZE];
+
+	s_EchoMode = ECHO_LEND;
+	s_EchoHold = true;
+	CHECK(outWait(CDC_DATA_EP, a, sizeof(a)) == SIE_ACK, "lent: first packet was not accepted");
+	frame();
+	const enum SIE_RESULT r = sie_Out(s_Addr, CDC_DATA_EP, b, sizeof(b), s_Toggle[CDC_DATA_EP][DIR_OUT]);
+	CHECK(r == SIE_NAK, "lent: second packet got %d instead of NAK", r);
+	s_EchoHold = false;
+	CHECK(outWait(CDC_DATA_EP, b, sizeof(b)) == SIE_ACK, "lent: second packet was not accepted after release");
+	CHECK(echoRead(got, sizeof(got)) == 1 && got[0] == 0x11, "lent: first packet was not echoed");
+	CHECK(echoRead(got, sizeof(got)) == 1 && got[0] == 0x22, "lent: second packet was not echoed");
+	return;
+}
+
+int main(void)
+{
+	enumerate();
+	if (s_Fail == 0) {
+		scenarioEcho(ECHO_GETS, "echo via getsUSBUSART");
+		scenarioEcho(ECHO_LEND, "echo via CDCRxGetPacket");
+		scenarioLent();
+	}
+	CHECK(s_ToggleErr == 0, "data toggle errors: %u", s_ToggleErr);
+	CHECK(sie_ErrCount() == 0, "SIE errors: %u", sie_ErrCount());
+	printf("usbsim: %s\n", s_Fail ? "FAIL" : "ok");
+	return s_Fail ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+/*********************************************************************
+* 波形の記録（vcd.h）
+*/
+#include <stdio.h>
+#include "mcu.h"
+#include "vcd.h"
+
+// 信号の識別子
+#define ID_CLK			'c'
+#define ID_DAT			'd'
+#define ID_CLK_DEV		'C'
+#define ID_DAT_DEV		'D'
+#define ID_CLK_HOST		'h'
+#define ID_DAT_HOST		'H'
+#define ID_TX			't'
+#define ID_RX			'r'
+
+static FILE *s_Fp;
+static simtime_t s_LastTime = SIM_NEVER;
+
+static void stamp(void)
+{
+	if (g_SimNow == s_LastTime)
+		return;
+	s_LastTime = g_SimNow;
+	fprintf(s_Fp, "#%llu\n", (unsigned long long)(g_SimNow * 1000 / SIM_CYC_PER_US));
+	return;
+}
+
+static void putBit(const char id, const int v)
+{
+	stamp();
+	fprintf(s_Fp, "%d%c\n", v ? 1 : 0, id);
+	return;
+}
+
+static void putByte(const char id, const uint8_t dt)
+{
+	stamp();
+	fputc('b', s_Fp);
+	for (int t = 7; 0 <= t; --t)
+		fputc('0' + ((dt >> t) & 1), s_Fp);
+	fprintf(s_Fp, " %c\n", id);
+	return;
+}
+
+static void onLine(const enum SIM_LINE line, const int level)
+{
+	putBit((line == SIM_CLK) ? ID_CLK : ID_DAT, level);
+	return;
+}
+
+static void onOut(const enum SIM_LINE line, const bool bHost, const int level)
+{
+	if (bHost)
+		putBit((line == SIM_CLK) ? ID_CLK_HOST : ID_DAT_HOST, level);
+	else
+		putBit((line == SIM_CLK) ? ID_CLK_DEV : ID_DAT_DEV, level);
+	return;
+}
+
+static void onTxDone(const uint8_t dt)
+{
+	putByte(ID_TX, dt);
+	return;
+}
+
+static void onRxDone(const uint8_t dt)
+{
+	putByte(ID_RX, dt);
+	return;
+}
+
+static const struct SIM_OBSERVER s_Observer = {
+	.onLine = onLine,
+	.onOut = onOut,
+	.onTxDone = onTxDone,
+	.onRxDone = onRxDone,
+};
+
+bool vcd_Open(const char *path)
+{
+	vcd_Close();	// 起動しなおすたびに開きなおす（最後の起動の波形が残る）
+	s_Fp = fopen(path, "w");
+	if (s_Fp == NULL)
+		return false;
+	fprintf(s_Fp,
+		"$timescale 1ns $end\n"
+		"$scope module ps2 $end\n"
+		"$var wire 1 %c clk $end\n"
+		"$var wire 1 %c dat $end\n"
+		"$var wire 1 %c clk_dev $end\n"
+		"$var wire 1 %c dat_dev $end\n"
+		"$var wire 1 %c clk_host $end\n"
+		"$var wire 1 %c dat_host $end\n"
+		"$var wire 8 %c tx_done $end\n"
+		"$var wire 8 %c rx_done $end\n"
+		"$upscope $end\n"
+		"$enddefinitions $end\n",
+		ID_CLK, ID_DAT, ID_CLK_DEV, ID_DAT_DEV, ID_CLK_HOST, ID_DAT_HOST, ID_TX, ID_RX);
+	s_LastTime = SIM_NEVER;
+	stamp();
+	fprintf(s_Fp, "$dumpvars\n");
+	fprintf(s_Fp, "%d%c\n%d%c\n", mcu_Level(SIM_CLK), ID_CLK, mcu_Level(SIM_DAT), ID_DAT);
+	fprintf(s_Fp, "1%c\n1%c\n1%c\n1%c\n", ID_CLK_DEV, ID_DAT_DEV, ID_CLK_HOST, ID_DAT_HOST);
+	fprintf(s_Fp, "bxxxxxxxx %c\nbxxxxxxxx %c\n", ID_TX, ID_RX);
+	fprintf(s_Fp, "$end\n");
+	mcu_AddObserver(&s_Observer);
+	return true;
+}
+
+void vcd_Close(void)
+{
+	if (s_Fp == NULL)
+		return;
+	stamp();
+	fclose(s_Fp);
+	s_Fp = NULL;
+	return;
+}
@@ -0,0 +1,19 @@
+#ifndef SIM_VCD_H
+#define SIM_VCD_H
+
+/*********************************************************************
+* 波形の記録（VCD、Value Change Dump）
+*	CLK、DATのラインのレベルと、デバイス側、ホスト側それぞれの出力、ファームウェアが送受信を
+*	終えたバイト（PS2_PROBE_TX_DONE、PS2_PROBE_RX_DONE）を記録する。GTKWave などで開ける。
+*	ファームウェアの送信のタイミングは実行時に決まる（g_Ps2Tx.prClkL、prClkH、prStopHold）ので、
+*	PS2_T_* の値ではなく、この波形で確かめる。
+*	時刻の単位は 1ns（命令サイクルから換算する）。
+*/
+
+#include <stdbool.h>
+
+// mcu_Reset() の後に呼ぶ。開いていれば閉じてから開きなおす。@return ファイルを開けたか
+bool vcd_Open(const char *path);
+void vcd_Close(void);
+
+#endif